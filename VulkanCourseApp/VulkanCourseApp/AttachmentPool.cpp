@@ -0,0 +1,230 @@
+#include "AttachmentPool.h"
+
+AttachmentPool::AttachmentPool()
+{
+}
+
+uint32_t AttachmentPool::addAttachment(const AttachmentInfo& info)
+{
+	Attachment attachment;
+	attachment.info = info;
+	attachments.push_back(attachment);
+	return static_cast<uint32_t>(attachments.size() - 1);
+}
+
+void AttachmentPool::create(DeviceAllocator* newAllocator, VkDevice newDevice, VkExtent2D extent)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	lazyAllocation = DeviceAllocation();
+	allocation = DeviceAllocation();
+
+	//Images first: their requirements decide the memory types and the placement
+	for(auto& attachment : attachments)
+	{
+		createImage(attachment, extent);
+
+		bool transient = (attachment.info.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+		attachment.lazy = transient && allocator->supportsProperties(attachment.requirements.memoryTypeBits,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+	}
+
+	//One allocation per group, every image bound at its offset
+	VkMemoryRequirements lazyRequirements = placeAttachments(true);
+	if(lazyRequirements.size > 0)
+	{
+		lazyAllocation = allocator->allocateMemory(lazyRequirements,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, MEMORY_CATEGORY_ATTACHMENTS);
+	}
+	VkMemoryRequirements requirements = placeAttachments(false);
+	if(requirements.size > 0)
+	{
+		allocation = allocator->allocateMemory(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_CATEGORY_ATTACHMENTS);
+	}
+
+	for(auto& attachment : attachments)
+	{
+		const DeviceAllocation& groupAllocation = attachment.lazy ? lazyAllocation : allocation;
+		VkResult result = vkBindImageMemory(device, attachment.image, groupAllocation.memory, groupAllocation.offset + attachment.offset);
+		if(result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to bind attachment memory!");
+		}
+
+		createImageView(attachment);
+	}
+}
+
+void AttachmentPool::destroy()
+{
+	if(allocator == nullptr) return;
+
+	for(auto& attachment : attachments)
+	{
+		if(attachment.image == VK_NULL_HANDLE) continue;
+
+		vkDestroyImageView(device, attachment.imageView, HostAllocator::getCallbacks());
+		vkDestroyImage(device, attachment.image, HostAllocator::getCallbacks());
+		attachment.image = VK_NULL_HANDLE;
+		attachment.imageView = VK_NULL_HANDLE;
+	}
+
+	allocator->free(lazyAllocation);
+	allocator->free(allocation);
+}
+
+VkImage AttachmentPool::getImage(uint32_t index)
+{
+	return attachments[index].image;
+}
+
+VkImageView AttachmentPool::getImageView(uint32_t index)
+{
+	return attachments[index].imageView;
+}
+
+VkDeviceSize AttachmentPool::getMemorySize()
+{
+	return lazyAllocation.size + allocation.size;
+}
+
+VkDeviceSize AttachmentPool::getUnaliasedSize()
+{
+	VkDeviceSize size = 0;
+	for(auto& attachment : attachments)
+	{
+		size += attachment.requirements.size;
+	}
+	return size;
+}
+
+bool AttachmentPool::usesLazilyAllocatedMemory()
+{
+	return lazyAllocation.memory != VK_NULL_HANDLE;
+}
+
+AttachmentPool::~AttachmentPool()
+{
+}
+
+VkMemoryRequirements AttachmentPool::placeAttachments(bool lazy)
+{
+	VkMemoryRequirements groupRequirements = {};
+	groupRequirements.alignment = 1;
+	groupRequirements.memoryTypeBits = ~0u;
+
+	//Biggest first, each one at the lowest offset not overlapping a placed attachment used in the same passes
+	std::vector<Attachment*> group;
+	for(auto& attachment : attachments)
+	{
+		if(attachment.lazy == lazy) group.push_back(&attachment);
+	}
+	std::sort(group.begin(), group.end(), [](const Attachment* a, const Attachment* b) {
+		return a->requirements.size > b->requirements.size;
+	});
+
+	std::vector<Attachment*> placed;
+	for(Attachment* attachment : group)
+	{
+		VkDeviceSize size = attachment->requirements.size;
+		VkDeviceSize alignment = attachment->requirements.alignment;
+
+		//Live at the same time: memory ranges must not overlap
+		std::vector<Attachment*> conflicts;
+		for(Attachment* other : placed)
+		{
+			if(attachment->info.firstPass <= other->info.lastPass && other->info.firstPass <= attachment->info.lastPass)
+			{
+				conflicts.push_back(other);
+			}
+		}
+
+		//Candidates: the start, or right after a conflicting attachment
+		std::vector<VkDeviceSize> candidates = {0};
+		for(Attachment* other : conflicts)
+		{
+			VkDeviceSize end = other->offset + other->requirements.size;
+			candidates.push_back((end + alignment - 1) / alignment * alignment);
+		}
+		std::sort(candidates.begin(), candidates.end());
+
+		for(VkDeviceSize candidate : candidates)
+		{
+			bool fits = true;
+			for(Attachment* other : conflicts)
+			{
+				if(candidate < other->offset + other->requirements.size && other->offset < candidate + size)
+				{
+					fits = false;
+					break;
+				}
+			}
+			if(fits)
+			{
+				attachment->offset = candidate;
+				break;
+			}
+		}
+		placed.push_back(attachment);
+
+		groupRequirements.size = std::max(groupRequirements.size, attachment->offset + size);
+		groupRequirements.alignment = std::max(groupRequirements.alignment, alignment);
+		groupRequirements.memoryTypeBits &= attachment->requirements.memoryTypeBits;
+	}
+
+	if(groupRequirements.size > 0 && groupRequirements.memoryTypeBits == 0)
+	{
+		throw std::runtime_error("Attachments have no memory type in common!");
+	}
+	return groupRequirements;
+}
+
+void AttachmentPool::createImage(Attachment& attachment, VkExtent2D extent)
+{
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.extent.width = extent.width;
+	imageCreateInfo.extent.height = extent.height;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.format = attachment.info.format;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.usage = attachment.info.usage;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateImage(device, &imageCreateInfo, HostAllocator::getCallbacks(), &attachment.image);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create an attachment image!");
+	}
+
+	vkGetImageMemoryRequirements(device, attachment.image, &attachment.requirements);
+}
+
+void AttachmentPool::createImageView(Attachment& attachment)
+{
+	VkImageViewCreateInfo viewCreateInfo = {};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.image = attachment.image;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.format = attachment.info.format;
+	viewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.subresourceRange.aspectMask = attachment.info.aspect;
+	viewCreateInfo.subresourceRange.baseMipLevel = 0;
+	viewCreateInfo.subresourceRange.levelCount = 1;
+	viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	viewCreateInfo.subresourceRange.layerCount = 1;
+
+	VkResult result = vkCreateImageView(device, &viewCreateInfo, HostAllocator::getCallbacks(), &attachment.imageView);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create attachment image view!");
+	}
+}
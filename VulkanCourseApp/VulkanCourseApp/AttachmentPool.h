@@ -0,0 +1,69 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+
+#include "DeviceAllocator.h"
+
+//One size dependent render target, described once and recreated with the swapchain
+struct AttachmentInfo {
+	VkFormat format;
+	VkImageUsageFlags usage;				//With TRANSIENT_ATTACHMENT: never loaded/stored, may live in lazily allocated memory
+	VkImageAspectFlags aspect;
+	uint32_t firstPass;						//First and last pass using it, attachments with disjoint ranges share memory
+	uint32_t lastPass;
+};
+
+//Render targets of one swapchain size, placed together in as few allocations as possible
+//Transient attachments go to lazily allocated memory when the device has it (tilers back it with tile memory only)
+//Attachments whose pass ranges don't overlap alias the same memory: every pass must start them from an UNDEFINED
+//layout (clear or don't care on load), their content is lost as soon as another one is written
+class AttachmentPool
+{
+public:
+	AttachmentPool();
+
+	//Describe every attachment before the first create, returns its index
+	uint32_t addAttachment(const AttachmentInfo& info);
+
+	//Create the images at this size and place them in memory (descriptions are kept for the next create)
+	void create(DeviceAllocator* newAllocator, VkDevice newDevice, VkExtent2D extent);
+	//Only once the GPU no longer uses them, a copy made before create can be destroyed later
+	void destroy();
+
+	VkImage getImage(uint32_t index);
+	VkImageView getImageView(uint32_t index);
+	//Bytes actually reserved, and what the attachments would take without aliasing
+	VkDeviceSize getMemorySize();
+	VkDeviceSize getUnaliasedSize();
+	bool usesLazilyAllocatedMemory();
+
+	~AttachmentPool();
+
+private:
+	DeviceAllocator* allocator = nullptr;
+	VkDevice device;
+
+	struct Attachment {
+		AttachmentInfo info;
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView imageView = VK_NULL_HANDLE;
+		VkMemoryRequirements requirements = {};
+		VkDeviceSize offset = 0;				//Inside the allocation of its group
+		bool lazy = false;
+	};
+	std::vector<Attachment> attachments;
+
+	//Lazily allocated attachments can't share memory with the others (their memory types differ)
+	DeviceAllocation lazyAllocation;
+	DeviceAllocation allocation;
+
+	//Offsets for the attachments of one group, returns the memory requirements of the whole group
+	VkMemoryRequirements placeAttachments(bool lazy);
+	void createImage(Attachment& attachment, VkExtent2D extent);
+	void createImageView(Attachment& attachment);
+};
@@ -0,0 +1,369 @@
+#include "CullingPass.h"
+
+CullingPass::CullingPass()
+{
+}
+
+void CullingPass::create(DeviceAllocator* newAllocator, VkDevice newDevice, InstanceBuffer* newInstanceBuffer, uint32_t frameCount)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	instanceBuffer = newInstanceBuffer;
+
+	createDescriptorSetLayout();
+	createPipelines();
+
+	//Sets of every frame come from here, given back all at once when the frame count changes
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = 7 * MAX_FRAMES_IN_FLIGHT;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[1].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+	poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolCreateInfo.pPoolSizes = poolSizes.data();
+
+	VkResult result = vkCreateDescriptorPool(device, &poolCreateInfo, HostAllocator::getCallbacks(), &descriptorPool);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling descriptor pool!");
+	}
+
+	createFrames(frameCount);
+}
+
+void CullingPass::destroy()
+{
+	destroyFrames();
+	vkDestroyDescriptorPool(device, descriptorPool, HostAllocator::getCallbacks());
+	vkDestroyPipeline(device, compactPipeline, HostAllocator::getCallbacks());
+	vkDestroyPipeline(device, cullPipeline, HostAllocator::getCallbacks());
+	vkDestroyPipelineLayout(device, pipelineLayout, HostAllocator::getCallbacks());
+	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, HostAllocator::getCallbacks());
+}
+
+void CullingPass::setFrameCount(uint32_t frameCount)
+{
+	destroyFrames();
+	vkResetDescriptorPool(device, descriptorPool, 0);
+	createFrames(frameCount);
+}
+
+void CullingPass::update(uint32_t frameIndex, const glm::mat4& viewProjection, CullMode cullMode, uint32_t meshCount)
+{
+	if(meshCount > MAX_MESHES)
+	{
+		throw std::runtime_error("Too many meshes for GPU culling!");
+	}
+
+	FrameResources& frame = frames[frameIndex];
+	CullHeader* header = static_cast<CullHeader*>(frame.cullDataAllocation.mappedData);
+
+	extractFrustumPlanes(viewProjection, header->frustumPlanes);
+	header->viewProjection = viewProjection;
+	header->meshCount = meshCount;
+	header->cullMode = cullMode;
+	header->occlusionTest = 0;
+	header->pyramidLevelCount = pyramidLevelCount;
+	header->pyramidSize = glm::vec2((float)pyramidExtent.width, (float)pyramidExtent.height);
+	frame.meshCount = meshCount;
+
+	//Pyramid was recreated since this frame's set was last used (the set is free now, its frame is done)
+	if(pyramidView != VK_NULL_HANDLE && frame.pyramidGeneration != pyramidGeneration)
+	{
+		VkDescriptorImageInfo pyramidInfo = {};
+		pyramidInfo.sampler = pyramidSampler;
+		pyramidInfo.imageView = pyramidView;
+		pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet setWrite = {};
+		setWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		setWrite.dstSet = frame.descriptorSet;
+		setWrite.dstBinding = 6;
+		setWrite.dstArrayElement = 0;
+		setWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		setWrite.descriptorCount = 1;
+		setWrite.pImageInfo = &pyramidInfo;
+
+		vkUpdateDescriptorSets(device, 1, &setWrite, 0, nullptr);
+		frame.pyramidGeneration = pyramidGeneration;
+	}
+}
+
+void CullingPass::setOcclusionTest(uint32_t frameIndex, const glm::mat4& pyramidViewProjection)
+{
+	CullHeader* header = static_cast<CullHeader*>(frames[frameIndex].cullDataAllocation.mappedData);
+	header->pyramidViewProjection = pyramidViewProjection;
+	header->occlusionTest = 1;
+}
+
+void CullingPass::setDepthPyramid(VkImageView newPyramidView, VkSampler newPyramidSampler, VkExtent2D newPyramidExtent,
+	uint32_t newPyramidLevelCount)
+{
+	pyramidView = newPyramidView;
+	pyramidSampler = newPyramidSampler;
+	pyramidExtent = newPyramidExtent;
+	pyramidLevelCount = newPyramidLevelCount;
+	pyramidGeneration++;
+}
+
+MeshCullData* CullingPass::getMeshData(uint32_t frameIndex)
+{
+	//Right after the header (its size keeps the array 16 byte aligned)
+	return reinterpret_cast<MeshCullData*>(static_cast<uint8_t*>(frames[frameIndex].cullDataAllocation.mappedData) + sizeof(CullHeader));
+}
+
+void CullingPass::record(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	FrameResources& frame = frames[frameIndex];
+
+	//Counters start at 0 every frame
+	vkCmdFillBuffer(commandBuffer, frame.visibleCountBuffer, 0, VK_WHOLE_SIZE, 0);
+	vkCmdFillBuffer(commandBuffer, frame.countBuffer, 0, VK_WHOLE_SIZE, 0);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+
+	recordPass(commandBuffer, frame, CULL_PASS_MAIN);
+
+	//Draw commands + count are read by the indirect draw, the visible list by the vertex shader
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void CullingPass::recordDisoccluded(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	FrameResources& frame = frames[frameIndex];
+
+	//Candidates (and their count) come from the main pass
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+
+	recordPass(commandBuffer, frame, CULL_PASS_DISOCCLUDED);
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+VkBuffer CullingPass::getVisibleBuffer(uint32_t frameIndex)
+{
+	return frames[frameIndex].visibleBuffer;
+}
+
+VkBuffer CullingPass::getDrawBuffer(uint32_t frameIndex)
+{
+	return frames[frameIndex].drawBuffer;
+}
+
+VkBuffer CullingPass::getCountBuffer(uint32_t frameIndex)
+{
+	return frames[frameIndex].countBuffer;
+}
+
+VkDeviceSize CullingPass::getDrawOffset(CullPass pass)
+{
+	return sizeof(VkDrawIndexedIndirectCommand) * (VkDeviceSize)MAX_MESHES * pass;
+}
+
+VkDeviceSize CullingPass::getCountOffset(CullPass pass)
+{
+	return sizeof(uint32_t) * (VkDeviceSize)pass;
+}
+
+CullingPass::~CullingPass()
+{
+}
+
+void CullingPass::createDescriptorSetLayout()
+{
+	//0: cull data, 1: instances, 2: visible counts, 3: visible list, 4: draw commands, 5: draw count, 6: depth pyramid,
+	//7: occlusion candidates
+	std::array<VkDescriptorSetLayoutBinding, 8> layoutBindings = {};
+	std::array<VkDescriptorBindingFlags, 8> bindingFlags = {};
+	for(uint32_t i = 0; i < layoutBindings.size(); i++)
+	{
+		layoutBindings[i].binding = i;
+		layoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layoutBindings[i].descriptorCount = 1;
+		layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		layoutBindings[i].pImmutableSamplers = nullptr;
+	}
+	//Only written once there is a pyramid, and only read when occlusion testing
+	layoutBindings[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindingFlags[6] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {};
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.pNext = &bindingFlagsInfo;
+	layoutCreateInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+	layoutCreateInfo.pBindings = layoutBindings.data();
+
+	VkResult result = vkCreateDescriptorSetLayout(device, &layoutCreateInfo, HostAllocator::getCallbacks(), &descriptorSetLayout);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling descriptor set layout!");
+	}
+}
+
+void CullingPass::createPipelines()
+{
+	//Both shaders use the same set, the CullPass they run for is a push constant
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(uint32_t);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	VkResult result = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, HostAllocator::getCallbacks(), &pipelineLayout);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling pipeline layout!");
+	}
+
+	cullPipeline = createComputePipeline(device, pipelineLayout, "Shaders/cull.spv");
+	compactPipeline = createComputePipeline(device, pipelineLayout, "Shaders/compact.spv");
+}
+
+void CullingPass::recordPass(VkCommandBuffer commandBuffer, FrameResources& frame, CullPass pass)
+{
+	uint32_t passIndex = pass;
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &passIndex);
+
+	//One thread per instance slot (64 per group, as in the shaders), for the disoccluded pass one per candidate:
+	//their count is only known on the GPU, threads past it return right away
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdDispatch(commandBuffer, (instanceBuffer->getCapacity() + 63) / 64, 1, 1);
+
+	//Compaction reads the final per mesh counts
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+
+	//One thread per mesh
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compactPipeline);
+	vkCmdDispatch(commandBuffer, (frame.meshCount + 63) / 64, 1, 1);
+}
+
+void CullingPass::createFrames(uint32_t frameCount)
+{
+	frames.resize(frameCount);
+
+	std::vector<VkDescriptorSetLayout> setLayouts(frameCount, descriptorSetLayout);
+	std::vector<VkDescriptorSet> descriptorSets(frameCount);
+
+	VkDescriptorSetAllocateInfo setAllocInfo = {};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = descriptorPool;
+	setAllocInfo.descriptorSetCount = frameCount;
+	setAllocInfo.pSetLayouts = setLayouts.data();
+
+	VkResult result = vkAllocateDescriptorSets(device, &setAllocInfo, descriptorSets.data());
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate culling descriptor sets!");
+	}
+
+	for(uint32_t i = 0; i < frameCount; i++)
+	{
+		FrameResources& frame = frames[i];
+		frame.descriptorSet = descriptorSets[i];
+		frame.meshCount = 0;
+		frame.pyramidGeneration = 0;
+
+		//Written by the CPU every frame
+		createBuffer(*allocator, device, sizeof(CullHeader) + sizeof(MeshCullData) * (VkDeviceSize)MAX_MESHES,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&frame.cullDataBuffer, &frame.cullDataAllocation, MEMORY_CATEGORY_UNIFORMS);
+		memset(frame.cullDataAllocation.mappedData, 0, sizeof(CullHeader));
+
+		//Written and read by the GPU only, a half per CullPass
+		createBuffer(*allocator, device, sizeof(uint32_t) * (VkDeviceSize)MAX_MESHES * 2,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&frame.visibleCountBuffer, &frame.visibleCountAllocation, MEMORY_CATEGORY_OTHER);
+		createBuffer(*allocator, device, sizeof(uint32_t) * (VkDeviceSize)instanceBuffer->getCapacity() * 2,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&frame.visibleBuffer, &frame.visibleAllocation, MEMORY_CATEGORY_OTHER);
+		createBuffer(*allocator, device, sizeof(VkDrawIndexedIndirectCommand) * (VkDeviceSize)MAX_MESHES * 2,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&frame.drawBuffer, &frame.drawAllocation, MEMORY_CATEGORY_OTHER);
+		createBuffer(*allocator, device, sizeof(uint32_t) * 4,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &frame.countBuffer, &frame.countAllocation, MEMORY_CATEGORY_OTHER);
+		createBuffer(*allocator, device, sizeof(uint32_t) * (VkDeviceSize)instanceBuffer->getCapacity(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&frame.candidateBuffer, &frame.candidateAllocation, MEMORY_CATEGORY_OTHER);
+
+		//Same order as the layout bindings (the pyramid is written by update)
+		std::array<VkDescriptorBufferInfo, 7> bufferInfos = {};
+		bufferInfos[0].buffer = frame.cullDataBuffer;
+		bufferInfos[1].buffer = instanceBuffer->getBuffer(i);
+		bufferInfos[2].buffer = frame.visibleCountBuffer;
+		bufferInfos[3].buffer = frame.visibleBuffer;
+		bufferInfos[4].buffer = frame.drawBuffer;
+		bufferInfos[5].buffer = frame.countBuffer;
+		bufferInfos[6].buffer = frame.candidateBuffer;
+
+		std::array<VkWriteDescriptorSet, 7> setWrites = {};
+		for(uint32_t j = 0; j < setWrites.size(); j++)
+		{
+			bufferInfos[j].offset = 0;
+			bufferInfos[j].range = VK_WHOLE_SIZE;
+
+			setWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			setWrites[j].dstSet = frame.descriptorSet;
+			setWrites[j].dstBinding = j < 6 ? j : j + 1;
+			setWrites[j].dstArrayElement = 0;
+			setWrites[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			setWrites[j].descriptorCount = 1;
+			setWrites[j].pBufferInfo = &bufferInfos[j];
+		}
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+	}
+}
+
+void CullingPass::destroyFrames()
+{
+	for(auto& frame : frames)
+	{
+		destroyBuffer(*allocator, device, frame.candidateBuffer, &frame.candidateAllocation);
+		destroyBuffer(*allocator, device, frame.countBuffer, &frame.countAllocation);
+		destroyBuffer(*allocator, device, frame.drawBuffer, &frame.drawAllocation);
+		destroyBuffer(*allocator, device, frame.visibleBuffer, &frame.visibleAllocation);
+		destroyBuffer(*allocator, device, frame.visibleCountBuffer, &frame.visibleCountAllocation);
+		destroyBuffer(*allocator, device, frame.cullDataBuffer, &frame.cullDataAllocation);
+	}
+	frames.clear();
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <array>
+
+#include "Utilities.h"
+#include "InstanceBuffer.h"
+
+//What culling needs to know about one mesh, indexed by mesh handle index (std430: 48 bytes)
+struct MeshCullData {
+	glm::vec4 bounds;					//Model space bounding sphere
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t instanceOffset;
+	uint32_t instanceCount;				//0 for free handle slots and meshes still uploading
+	uint32_t padding[3];
+};
+
+//What decides which live instances are visible
+enum CullMode {
+	CULL_MODE_NONE = 0,					//Every one
+	CULL_MODE_FRUSTUM = 1				//Frustum test on the GPU
+};
+
+//Which half of the visible list, draws and draw counts a pass fills
+enum CullPass {
+	CULL_PASS_MAIN = 0,					//Everything not hidden by last frame's depth
+	CULL_PASS_DISOCCLUDED = 1			//What that test rejected but this frame's depth shows (occlusion culling only)
+};
+
+//Start of the cull data buffer, the MeshCullData array follows it (std430: 256 bytes)
+struct CullHeader {
+	glm::vec4 frustumPlanes[6];			//xyz = normal pointing inside, w = distance
+	glm::mat4 viewProjection;			//This frame's, for the disoccluded pass
+	glm::mat4 pyramidViewProjection;	//The one last frame's depth was rendered with, for the main pass
+	uint32_t meshCount;					//Entries of the mesh array
+	uint32_t cullMode;					//CullMode
+	uint32_t occlusionTest;				//1: the main pass tests against the depth pyramid (it holds last frame's depth)
+	uint32_t pyramidLevelCount;
+	glm::vec2 pyramidSize;				//Of level 0, in texels (= depth attachment size)
+	uint32_t padding[2];
+};
+
+//Frustum culling on the GPU: a compute pass tests every instance of the instance buffer against the camera frustum,
+//then compacts the meshes that kept instances into indirect draw commands + a draw count for vkCmdDrawIndexedIndirectCount
+//1. cull.spv, one thread per instance slot: visible instances get a place in their mesh's range of the visible list
+//2. compact.spv, one thread per mesh: meshes with visible instances append their draw command
+//The vertex shader then reads instances through the visible list (gl_InstanceIndex = place in it), the other draw paths
+//don't record this pass and have gl_InstanceIndex be the instance slot itself
+//Everything is per frame in flight, the CPU only writes the frustum and the per mesh data (no per instance work)
+//Occlusion culling (with a DepthPyramid): the main pass also tests frustum visible instances against last frame's depth,
+//the rejected ones go to a candidate list. Once the main draws are done and the pyramid rebuilt from their depth,
+//recordDisoccluded tests the candidates again with this frame's depth, what became visible gets its own draws
+//Visible list, draws and counts have a half per CullPass, the vertex shader reads both through the same binding
+class CullingPass
+{
+public:
+	CullingPass();
+
+	void create(DeviceAllocator* newAllocator, VkDevice newDevice, InstanceBuffer* newInstanceBuffer, uint32_t frameCount);
+	void destroy();
+	//Frames in flight changed, after the instance buffer (its frame buffers are bound here), the GPU must be idle
+	void setFrameCount(uint32_t frameCount);
+
+	//Frame data, written once the GPU finished the frame's last submit
+	void update(uint32_t frameIndex, const glm::mat4& viewProjection, CullMode cullMode, uint32_t meshCount);
+	//After update: the pyramid holds the depth of pyramidViewProjection, the main pass tests against it
+	void setOcclusionTest(uint32_t frameIndex, const glm::mat4& pyramidViewProjection);
+	//Pyramid the occlusion tests read (full mip chain, GENERAL layout), a frame's set picks it up at its next update
+	void setDepthPyramid(VkImageView pyramidView, VkSampler pyramidSampler, VkExtent2D pyramidExtent, uint32_t pyramidLevelCount);
+	//meshCount entries (as given to update), to be filled by the caller
+	MeshCullData* getMeshData(uint32_t frameIndex);
+
+	//Outside a render pass: reset counters, cull, compact, and make the results visible to indirect draws + vertex shaders
+	void record(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	//Same for the candidates the main pass rejected, after the pyramid was rebuilt from the main draws' depth
+	void recordDisoccluded(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+	//Instance slots in draw order, what the vertex shader indexes with gl_InstanceIndex
+	VkBuffer getVisibleBuffer(uint32_t frameIndex);
+	//Compacted VkDrawIndexedIndirectCommand array and its uint32_t count, at the offsets of each pass
+	VkBuffer getDrawBuffer(uint32_t frameIndex);
+	VkBuffer getCountBuffer(uint32_t frameIndex);
+	VkDeviceSize getDrawOffset(CullPass pass);
+	VkDeviceSize getCountOffset(CullPass pass);
+
+	~CullingPass();
+
+private:
+	DeviceAllocator* allocator;
+	VkDevice device;
+	InstanceBuffer* instanceBuffer;
+
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorPool descriptorPool;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline cullPipeline;
+	VkPipeline compactPipeline;
+
+	VkImageView pyramidView = VK_NULL_HANDLE;
+	VkSampler pyramidSampler = VK_NULL_HANDLE;
+	VkExtent2D pyramidExtent = {};
+	uint32_t pyramidLevelCount = 0;
+	uint32_t pyramidGeneration = 0;				//Bumped by setDepthPyramid, frames rewrite their binding when theirs is older
+
+	struct FrameResources {
+		VkBuffer cullDataBuffer;				//CullHeader + MeshCullData, host visible
+		DeviceAllocation cullDataAllocation;
+		VkBuffer visibleCountBuffer;			//Visible instances per mesh
+		DeviceAllocation visibleCountAllocation;
+		VkBuffer visibleBuffer;
+		DeviceAllocation visibleAllocation;
+		VkBuffer drawBuffer;
+		DeviceAllocation drawAllocation;
+		VkBuffer countBuffer;					//Draw count of each pass, then the candidate count
+		DeviceAllocation countAllocation;
+		VkBuffer candidateBuffer;				//Slots the main pass found occluded
+		DeviceAllocation candidateAllocation;
+		VkDescriptorSet descriptorSet;
+		uint32_t meshCount = 0;
+		uint32_t pyramidGeneration = 0;
+	};
+	std::vector<FrameResources> frames;
+
+	void createDescriptorSetLayout();
+	void createPipelines();
+	//One cull + compact for the given pass (counters already reset)
+	void recordPass(VkCommandBuffer commandBuffer, FrameResources& frame, CullPass pass);
+	void createFrames(uint32_t frameCount);
+	void destroyFrames();
+};
@@ -0,0 +1,39 @@
+#include "DeletionQueue.h"
+
+DeletionQueue::DeletionQueue()
+{
+}
+
+void DeletionQueue::push(uint64_t timelineValue, std::function<void()> deleter)
+{
+	PendingDeletion deletion;
+	deletion.timelineValue = timelineValue;
+	deletion.deleter = deleter;
+	pendingDeletions.push_back(deletion);
+}
+
+size_t DeletionQueue::flush(TimelineScheduler& timeline, bool all)
+{
+	//Stop at the first one still in use, everything after it was pushed later
+	size_t deletedCount = 0;
+	while(!pendingDeletions.empty())
+	{
+		if(!all && !timeline.isComplete(pendingDeletions.front().timelineValue)) break;
+
+		//Out of the queue first, a deleter may push new deletions
+		std::function<void()> deleter = pendingDeletions.front().deleter;
+		pendingDeletions.pop_front();
+		deleter();
+		deletedCount++;
+	}
+	return deletedCount;
+}
+
+size_t DeletionQueue::getPendingCount()
+{
+	return pendingDeletions.size();
+}
+
+DeletionQueue::~DeletionQueue()
+{
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+
+#include "TimelineScheduler.h"
+
+//Resources the GPU may still be using, destroyed once the timeline passes the last submit that could use them
+//Push with timeline.getLastSubmittedValue() right after the resource is unlinked (no later frame can reference it),
+//then flush every frame: nothing ever waits, a resource just lives a few frames longer
+class DeletionQueue
+{
+public:
+	DeletionQueue();
+
+	void push(uint64_t timelineValue, std::function<void()> deleter);
+
+	//Run the deleters the GPU is done with (all: everything, only after vkDeviceWaitIdle), returns how many ran
+	size_t flush(TimelineScheduler& timeline, bool all);
+
+	size_t getPendingCount();
+
+	~DeletionQueue();
+
+private:
+	struct PendingDeletion {
+		uint64_t timelineValue;
+		std::function<void()> deleter;
+	};
+
+	//Pushed with non decreasing values, so the oldest is always at the front
+	std::deque<PendingDeletion> pendingDeletions;
+};
@@ -0,0 +1,331 @@
+#include "DepthPyramid.h"
+
+DepthPyramid::DepthPyramid()
+{
+}
+
+void DepthPyramid::create(DeviceAllocator* newAllocator, VkDevice newDevice)
+{
+	allocator = newAllocator;
+	device = newDevice;
+
+	createSampler();
+	createPipeline();
+}
+
+void DepthPyramid::createImages(VkExtent2D newExtent, VkImageView depthView)
+{
+	extent = newExtent;
+	initialized = false;
+
+	//Down to 1x1
+	levelCount = 1;
+	while((std::max(extent.width, extent.height) >> levelCount) > 0)
+	{
+		levelCount++;
+	}
+
+	createImage();
+	imageView = createImageView(0, levelCount);
+	levelViews.clear();
+	for(uint32_t i = 0; i < levelCount; i++)
+	{
+		levelViews.push_back(createImageView(i, 1));
+	}
+	createDescriptorPool();
+	createDescriptorSets(depthView);
+}
+
+void DepthPyramid::destroyImages()
+{
+	if(image == VK_NULL_HANDLE) return;
+
+	//Freeing the pool frees its sets
+	vkDestroyDescriptorPool(device, descriptorPool, HostAllocator::getCallbacks());
+	for(auto levelView : levelViews)
+	{
+		vkDestroyImageView(device, levelView, HostAllocator::getCallbacks());
+	}
+	levelViews.clear();
+	vkDestroyImageView(device, imageView, HostAllocator::getCallbacks());
+	vkDestroyImage(device, image, HostAllocator::getCallbacks());
+	allocator->free(imageAllocation);
+	image = VK_NULL_HANDLE;
+}
+
+void DepthPyramid::destroy()
+{
+	if(allocator == nullptr) return;
+
+	destroyImages();
+	vkDestroyPipeline(device, pipeline, HostAllocator::getCallbacks());
+	vkDestroyPipelineLayout(device, pipelineLayout, HostAllocator::getCallbacks());
+	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, HostAllocator::getCallbacks());
+	vkDestroySampler(device, sampler, HostAllocator::getCallbacks());
+	allocator = nullptr;
+}
+
+void DepthPyramid::record(VkCommandBuffer commandBuffer)
+{
+	//Previous frame's tests may still read it (write after read), the first build also leaves UNDEFINED
+	VkImageMemoryBarrier imageBarrier = {};
+	imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageBarrier.oldLayout = initialized ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrier.image = image;
+	imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageBarrier.subresourceRange.baseMipLevel = 0;
+	imageBarrier.subresourceRange.levelCount = levelCount;
+	imageBarrier.subresourceRange.baseArrayLayer = 0;
+	imageBarrier.subresourceRange.layerCount = 1;
+	imageBarrier.srcAccessMask = 0;
+	imageBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &imageBarrier);
+	initialized = true;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	for(uint32_t i = 0; i < levelCount; i++)
+	{
+		uint32_t copyDepth = i == 0 ? 1 : 0;
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &levelSets[i], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &copyDepth);
+
+		//8x8 texels per group, as in the shader
+		uint32_t levelWidth = std::max(1u, extent.width >> i);
+		uint32_t levelHeight = std::max(1u, extent.height >> i);
+		vkCmdDispatch(commandBuffer, (levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+
+		//Next level reads this one, after the last one the culling shaders read them all
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			1, &barrier, 0, nullptr, 0, nullptr);
+	}
+}
+
+VkImageView DepthPyramid::getImageView()
+{
+	return imageView;
+}
+
+VkSampler DepthPyramid::getSampler()
+{
+	return sampler;
+}
+
+VkExtent2D DepthPyramid::getExtent()
+{
+	return extent;
+}
+
+uint32_t DepthPyramid::getLevelCount()
+{
+	return levelCount;
+}
+
+DepthPyramid::~DepthPyramid()
+{
+}
+
+void DepthPyramid::createImage()
+{
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.extent.width = extent.width;
+	imageCreateInfo.extent.height = extent.height;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.mipLevels = levelCount;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.format = VK_FORMAT_R32G32_SFLOAT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateImage(device, &imageCreateInfo, HostAllocator::getCallbacks(), &image);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create the depth pyramid image!");
+	}
+
+	imageAllocation = allocator->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_CATEGORY_ATTACHMENTS);
+}
+
+VkImageView DepthPyramid::createImageView(uint32_t baseLevel, uint32_t viewLevelCount)
+{
+	VkImageViewCreateInfo viewCreateInfo = {};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.image = image;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.format = VK_FORMAT_R32G32_SFLOAT;
+	viewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewCreateInfo.subresourceRange.baseMipLevel = baseLevel;
+	viewCreateInfo.subresourceRange.levelCount = viewLevelCount;
+	viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	viewCreateInfo.subresourceRange.layerCount = 1;
+
+	VkImageView view;
+	VkResult result = vkCreateImageView(device, &viewCreateInfo, HostAllocator::getCallbacks(), &view);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create a depth pyramid image view!");
+	}
+	return view;
+}
+
+void DepthPyramid::createSampler()
+{
+	//Only texelFetch goes through it (exact texels, explicit level), for the depth attachment too
+	VkSamplerCreateInfo samplerCreateInfo = {};
+	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerCreateInfo.mipLodBias = 0.0f;
+	samplerCreateInfo.minLod = 0.0f;
+	samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;						//Level count follows the size, the sampler doesn't
+	samplerCreateInfo.anisotropyEnable = VK_FALSE;
+
+	VkResult result = vkCreateSampler(device, &samplerCreateInfo, HostAllocator::getCallbacks(), &sampler);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create the depth pyramid sampler!");
+	}
+}
+
+void DepthPyramid::createPipeline()
+{
+	//0: source (depth attachment or previous level), 1: level being built
+	std::array<VkDescriptorSetLayoutBinding, 2> layoutBindings = {};
+	layoutBindings[0].binding = 0;
+	layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	layoutBindings[0].descriptorCount = 1;
+	layoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[0].pImmutableSamplers = nullptr;
+	layoutBindings[1].binding = 1;
+	layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	layoutBindings[1].descriptorCount = 1;
+	layoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[1].pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+	layoutCreateInfo.pBindings = layoutBindings.data();
+
+	VkResult result = vkCreateDescriptorSetLayout(device, &layoutCreateInfo, HostAllocator::getCallbacks(), &descriptorSetLayout);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid descriptor set layout!");
+	}
+
+	//Whether the source is the depth attachment
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(uint32_t);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	result = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, HostAllocator::getCallbacks(), &pipelineLayout);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid pipeline layout!");
+	}
+
+	pipeline = createComputePipeline(device, pipelineLayout, "Shaders/pyramid.spv");
+}
+
+void DepthPyramid::createDescriptorPool()
+{
+	//One set per level, so sized with the image
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = levelCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = levelCount;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = levelCount;
+	poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolCreateInfo.pPoolSizes = poolSizes.data();
+
+	VkResult result = vkCreateDescriptorPool(device, &poolCreateInfo, HostAllocator::getCallbacks(), &descriptorPool);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid descriptor pool!");
+	}
+}
+
+void DepthPyramid::createDescriptorSets(VkImageView depthView)
+{
+	std::vector<VkDescriptorSetLayout> setLayouts(levelCount, descriptorSetLayout);
+	levelSets.resize(levelCount);
+
+	VkDescriptorSetAllocateInfo setAllocInfo = {};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = descriptorPool;
+	setAllocInfo.descriptorSetCount = levelCount;
+	setAllocInfo.pSetLayouts = setLayouts.data();
+
+	VkResult result = vkAllocateDescriptorSets(device, &setAllocInfo, levelSets.data());
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate depth pyramid descriptor sets!");
+	}
+
+	for(uint32_t i = 0; i < levelCount; i++)
+	{
+		//Level 0 reads the depth attachment, the others the level before them
+		VkDescriptorImageInfo sourceInfo = {};
+		sourceInfo.sampler = sampler;
+		sourceInfo.imageView = i == 0 ? depthView : levelViews[i - 1];
+		sourceInfo.imageLayout = i == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo destinationInfo = {};
+		destinationInfo.imageView = levelViews[i];
+		destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> setWrites = {};
+		setWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		setWrites[0].dstSet = levelSets[i];
+		setWrites[0].dstBinding = 0;
+		setWrites[0].dstArrayElement = 0;
+		setWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		setWrites[0].descriptorCount = 1;
+		setWrites[0].pImageInfo = &sourceInfo;
+		setWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		setWrites[1].dstSet = levelSets[i];
+		setWrites[1].dstBinding = 1;
+		setWrites[1].dstArrayElement = 0;
+		setWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		setWrites[1].descriptorCount = 1;
+		setWrites[1].pImageInfo = &destinationInfo;
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+#include <array>
+#include <algorithm>
+
+#include "Utilities.h"
+
+//Hierarchical depth of the last rendered frame, for occlusion culling
+//Level 0 is a copy of the depth attachment, each next level is half the size, every texel holding the nearest (r) and
+//farthest (g) depth of the texels it covers: a sphere hidden behind the farthest depth of the 2x2 texels covering its
+//screen rect is hidden behind everything there
+//Built by compute (pyramid.spv, one dispatch per level) after the pass that wrote the depth
+//Pipeline and sampler are created once, only the image and its descriptor sets are recreated with the swapchain
+//The image stays in GENERAL layout: levels are written as storage images and read back as sampled ones
+class DepthPyramid
+{
+public:
+	DepthPyramid();
+
+	//Size independent part: pipeline, layouts and sampler
+	void create(DeviceAllocator* newAllocator, VkDevice newDevice);
+	//depthView: depth aspect of the attachment, in DEPTH_STENCIL_READ_ONLY_OPTIMAL layout when record runs
+	void createImages(VkExtent2D newExtent, VkImageView depthView);
+	//Only once the GPU no longer uses them, a copy made before createImages can destroy the old ones later
+	void destroyImages();
+	void destroy();
+
+	//Outside a render pass, after the depth writes were made visible to compute: build every level,
+	//then make them visible to the culling shaders
+	void record(VkCommandBuffer commandBuffer);
+
+	//Whole mip chain, with the nearest filtering sampler the tests fetch through
+	VkImageView getImageView();
+	VkSampler getSampler();
+	VkExtent2D getExtent();
+	uint32_t getLevelCount();
+
+	~DepthPyramid();
+
+private:
+	DeviceAllocator* allocator = nullptr;
+	VkDevice device;
+	VkExtent2D extent = {};
+	uint32_t levelCount = 0;
+	bool initialized = false;					//Moved out of UNDEFINED by the first record
+
+	VkImage image = VK_NULL_HANDLE;
+	DeviceAllocation imageAllocation;
+	VkImageView imageView = VK_NULL_HANDLE;
+	std::vector<VkImageView> levelViews;		//One per level, written as storage and read as source of the next
+	VkSampler sampler = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorPool descriptorPool;
+	std::vector<VkDescriptorSet> levelSets;		//Source + destination of each level
+	VkPipelineLayout pipelineLayout;
+	VkPipeline pipeline;
+
+	void createImage();
+	void createDescriptorPool();
+	VkImageView createImageView(uint32_t baseLevel, uint32_t viewLevelCount);
+	void createSampler();
+	void createPipeline();
+	void createDescriptorSets(VkImageView depthView);
+};
@@ -0,0 +1,602 @@
+#include "DeviceAllocator.h"
+
+#include <algorithm>
+
+DeviceAllocator::DeviceAllocator()
+{
+}
+
+void DeviceAllocator::create(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, bool newMemoryBudgetSupported,
+	VkDeviceSize newBlockSize)
+{
+	physicalDevice = newPhysicalDevice;
+	device = newDevice;
+	memoryBudgetSupported = newMemoryBudgetSupported;
+	blockSize = newBlockSize;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	pools.clear();
+	dedicatedCount.assign(memoryProperties.memoryHeapCount, 0);
+	dedicatedBytes.assign(memoryProperties.memoryHeapCount, 0);
+	categoryBytes.assign(memoryProperties.memoryHeapCount, std::array<VkDeviceSize, MEMORY_CATEGORY_COUNT>());
+
+	//Without the extension: only our own allocations are known, keep some of the heap for everyone else
+	heapUsage.assign(memoryProperties.memoryHeapCount, 0);
+	heapBudget.resize(memoryProperties.memoryHeapCount);
+	for(uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+	{
+		heapBudget[i] = memoryProperties.memoryHeaps[i].size / 10 * 8;
+	}
+	updateBudget();
+
+	//The small (256 MB) BAR window is a heap of its own, only count it when the whole biggest device local heap is mappable
+	uint32_t vramHeap = 0;
+	VkDeviceSize vramHeapSize = 0;
+	for(uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+	{
+		if((memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && memoryProperties.memoryHeaps[i].size > vramHeapSize)
+		{
+			vramHeap = i;
+			vramHeapSize = memoryProperties.memoryHeaps[i].size;
+		}
+	}
+	VkMemoryPropertyFlags directWriteProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	hostVisibleDeviceLocal = false;
+	for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+	{
+		if(memoryProperties.memoryTypes[i].heapIndex == vramHeap
+			&& (memoryProperties.memoryTypes[i].propertyFlags & directWriteProperties) == directWriteProperties)
+		{
+			hostVisibleDeviceLocal = true;
+		}
+	}
+}
+
+void DeviceAllocator::destroy()
+{
+	std::lock_guard<std::mutex> lock(allocatorMutex);
+
+	for(auto& pool : pools)
+	{
+		for(auto& block : pool.blocks)
+		{
+			if(block)
+			{
+				destroyBlock(pool, *block);
+			}
+		}
+	}
+	pools.clear();
+}
+
+DeviceAllocation DeviceAllocator::allocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags properties, DeviceMemoryCategory category)
+{
+	//Ask the driver if this buffer wants its own allocation
+	VkMemoryDedicatedRequirements dedicatedRequirements = {};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 memoryRequirements = {};
+	memoryRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	memoryRequirements.pNext = &dedicatedRequirements;
+
+	VkBufferMemoryRequirementsInfo2 requirementsInfo = {};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.buffer = buffer;
+	vkGetBufferMemoryRequirements2(device, &requirementsInfo, &memoryRequirements);
+
+	bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+	DeviceAllocation allocation = allocate(memoryRequirements.memoryRequirements, properties, category, true, dedicated,
+		buffer, VK_NULL_HANDLE);
+
+	VkResult result = vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to bind buffer memory!");
+	}
+
+	return allocation;
+}
+
+DeviceAllocation DeviceAllocator::allocateImageMemory(VkImage image, VkMemoryPropertyFlags properties, DeviceMemoryCategory category)
+{
+	//Render targets and large textures usually prefer a dedicated allocation
+	VkMemoryDedicatedRequirements dedicatedRequirements = {};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 memoryRequirements = {};
+	memoryRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	memoryRequirements.pNext = &dedicatedRequirements;
+
+	VkImageMemoryRequirementsInfo2 requirementsInfo = {};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.image = image;
+	vkGetImageMemoryRequirements2(device, &requirementsInfo, &memoryRequirements);
+
+	bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+	DeviceAllocation allocation = allocate(memoryRequirements.memoryRequirements, properties, category, false, dedicated,
+		VK_NULL_HANDLE, image);
+
+	VkResult result = vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to bind image memory!");
+	}
+
+	return allocation;
+}
+
+DeviceAllocation DeviceAllocator::allocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+	DeviceMemoryCategory category)
+{
+	return allocate(requirements, properties, category, false, false, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
+
+void DeviceAllocator::free(DeviceAllocation& allocation)
+{
+	if(allocation.memory == VK_NULL_HANDLE) return;
+
+	std::lock_guard<std::mutex> lock(allocatorMutex);
+
+	uint32_t heapIndex = getHeapIndex(allocation.memoryTypeIndex);
+	categoryBytes[heapIndex][allocation.category] -= allocation.size;
+
+	if(allocation.dedicated)
+	{
+		//Freeing also unmaps
+		vkFreeMemory(device, allocation.memory, HostAllocator::getCallbacks());
+		dedicatedCount[heapIndex]--;
+		dedicatedBytes[heapIndex] -= allocation.size;
+		heapUsage[heapIndex] -= std::min(heapUsage[heapIndex], allocation.size);
+	}
+	else
+	{
+		MemoryPool& pool = pools[allocation.poolIndex];
+		std::unique_ptr<MemoryBlock>& block = pool.blocks[allocation.blockIndex];
+		freeFromBlock(*block, allocation.offset);
+
+		//Give empty blocks back to the driver, but keep one per pool to avoid allocation churn
+		if(block->allocationCount == 0)
+		{
+			uint32_t liveBlocks = 0;
+			for(auto& poolBlock : pool.blocks)
+			{
+				if(poolBlock) liveBlocks++;
+			}
+			if(liveBlocks > 1)
+			{
+				destroyBlock(pool, *block);
+				block.reset();
+			}
+		}
+	}
+
+	allocation = DeviceAllocation();
+}
+
+void DeviceAllocator::updateBudget()
+{
+	//Nothing to ask: the estimate from create is kept up to date by our own allocations
+	if(!memoryBudgetSupported) return;
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+	budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+	VkPhysicalDeviceMemoryProperties2 memoryProperties2 = {};
+	memoryProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	memoryProperties2.pNext = &budgetProperties;
+	vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties2);
+
+	std::lock_guard<std::mutex> lock(allocatorMutex);
+	for(uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+	{
+		heapBudget[i] = budgetProperties.heapBudget[i];
+		heapUsage[i] = budgetProperties.heapUsage[i];
+	}
+}
+
+bool DeviceAllocator::hasHostVisibleDeviceLocal()
+{
+	return hostVisibleDeviceLocal;
+}
+
+bool DeviceAllocator::supportsProperties(uint32_t allowedTypes, VkMemoryPropertyFlags properties)
+{
+	for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+	{
+		if((allowedTypes & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<DeviceHeapStats> DeviceAllocator::getHeapStats()
+{
+	std::lock_guard<std::mutex> lock(allocatorMutex);
+
+	std::vector<DeviceHeapStats> heapStats(memoryProperties.memoryHeapCount);
+	for(uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+	{
+		heapStats[i].heapSize = memoryProperties.memoryHeaps[i].size;
+		heapStats[i].dedicatedCount = dedicatedCount[i];
+		heapStats[i].dedicatedBytes = dedicatedBytes[i];
+		heapStats[i].budget = heapBudget[i];
+		heapStats[i].usage = heapUsage[i];
+		heapStats[i].categoryBytes = categoryBytes[i];
+	}
+
+	for(auto& pool : pools)
+	{
+		DeviceHeapStats& stats = heapStats[memoryProperties.memoryTypes[pool.memoryTypeIndex].heapIndex];
+		for(auto& block : pool.blocks)
+		{
+			if(!block) continue;
+			stats.blockCount++;
+			stats.blockBytes += pool.blockSize;
+			stats.allocationCount += block->allocationCount;
+			stats.usedBytes += block->usedBytes;
+		}
+	}
+
+	return heapStats;
+}
+
+const char* DeviceAllocator::getCategoryName(DeviceMemoryCategory category)
+{
+	switch(category)
+	{
+	case MEMORY_CATEGORY_MESHES:		return "Meshes";
+	case MEMORY_CATEGORY_TEXTURES:		return "Textures";
+	case MEMORY_CATEGORY_UNIFORMS:		return "Uniforms";
+	case MEMORY_CATEGORY_ATTACHMENTS:	return "Attachments";
+	case MEMORY_CATEGORY_STAGING:		return "Staging";
+	default:							return "Other";
+	}
+}
+
+uint32_t DeviceAllocator::getDeviceMemoryCount()
+{
+	std::lock_guard<std::mutex> lock(allocatorMutex);
+
+	uint32_t count = 0;
+	for(uint32_t heapCount : dedicatedCount)
+	{
+		count += heapCount;
+	}
+	for(auto& pool : pools)
+	{
+		for(auto& block : pool.blocks)
+		{
+			if(block) count++;
+		}
+	}
+	return count;
+}
+
+DeviceAllocator::~DeviceAllocator()
+{
+}
+
+DeviceAllocation DeviceAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+	DeviceMemoryCategory category, bool linear, bool dedicated, VkBuffer dedicatedBuffer, VkImage dedicatedImage)
+{
+	std::lock_guard<std::mutex> lock(allocatorMutex);
+
+	std::vector<uint32_t> memoryTypes = findMemoryTypes(requirements.memoryTypeBits, properties);
+
+	//First pass keeps every heap within its budget, the second takes whatever the driver still gives
+	for(int pass = 0; pass < 2; pass++)
+	{
+		for(uint32_t memoryTypeIndex : memoryTypes)
+		{
+			DeviceAllocation allocation;
+			if(allocateFromType(requirements, memoryTypeIndex, linear, dedicated, dedicatedBuffer, dedicatedImage, pass == 0, &allocation))
+			{
+				allocation.category = category;
+				categoryBytes[getHeapIndex(memoryTypeIndex)][category] += allocation.size;
+				return allocation;
+			}
+		}
+	}
+
+	throw std::runtime_error("Failed to allocate device memory!");
+}
+
+bool DeviceAllocator::allocateFromType(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, bool linear, bool dedicated,
+	VkBuffer dedicatedBuffer, VkImage dedicatedImage, bool respectBudget, DeviceAllocation* allocation)
+{
+	uint32_t heapIndex = getHeapIndex(memoryTypeIndex);
+	uint32_t poolIndex = getPoolIndex(memoryTypeIndex, linear);
+	MemoryPool& pool = pools[poolIndex];
+
+	//Buddy nodes are aligned to their size, so a node as big as the alignment satisfies it
+	VkDeviceSize nodeSize = MIN_NODE_SIZE;
+	uint32_t order = 0;
+	while(nodeSize < requirements.size || nodeSize < requirements.alignment)
+	{
+		nodeSize <<= 1;
+		order++;
+	}
+
+	//Anything bigger than half a block would waste most of it
+	if(dedicated || nodeSize > pool.blockSize / 2)
+	{
+		if(respectBudget && !fitsBudget(heapIndex, requirements.size))
+		{
+			return false;
+		}
+		return allocateDedicated(requirements, memoryTypeIndex, dedicatedBuffer, dedicatedImage, allocation);
+	}
+
+	allocation->memoryTypeIndex = memoryTypeIndex;
+	allocation->poolIndex = poolIndex;
+	allocation->size = nodeSize;
+
+	//First fit in existing blocks (already counted in the usage, so no budget check)
+	for(uint32_t i = 0; i < pool.blocks.size(); i++)
+	{
+		if(pool.blocks[i] && allocateFromBlock(*pool.blocks[i], order, &allocation->offset))
+		{
+			allocation->blockIndex = i;
+			allocation->memory = pool.blocks[i]->memory;
+			allocation->mappedData = pool.blocks[i]->mappedData
+				? static_cast<uint8_t*>(pool.blocks[i]->mappedData) + allocation->offset : nullptr;
+			return true;
+		}
+	}
+
+	//Otherwise a new block, in an empty slot (or appended)
+	if(respectBudget && !fitsBudget(heapIndex, pool.blockSize))
+	{
+		return false;
+	}
+	std::unique_ptr<MemoryBlock> newBlock = createBlock(pool);
+	if(!newBlock)
+	{
+		return false;
+	}
+
+	uint32_t blockIndex = static_cast<uint32_t>(pool.blocks.size());
+	for(uint32_t i = 0; i < pool.blocks.size(); i++)
+	{
+		if(!pool.blocks[i])
+		{
+			blockIndex = i;
+			break;
+		}
+	}
+	if(blockIndex == pool.blocks.size())
+	{
+		pool.blocks.emplace_back();
+	}
+	pool.blocks[blockIndex] = std::move(newBlock);
+
+	MemoryBlock& block = *pool.blocks[blockIndex];
+	allocateFromBlock(block, order, &allocation->offset);
+	allocation->blockIndex = blockIndex;
+	allocation->memory = block.memory;
+	allocation->mappedData = block.mappedData ? static_cast<uint8_t*>(block.mappedData) + allocation->offset : nullptr;
+
+	return true;
+}
+
+bool DeviceAllocator::allocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex,
+	VkBuffer dedicatedBuffer, VkImage dedicatedImage, DeviceAllocation* allocation)
+{
+	//Tell the driver which resource the memory is for, it may place it better (e.g. compressed render targets)
+	VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+	dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicatedInfo.buffer = dedicatedBuffer;
+	dedicatedInfo.image = dedicatedImage;
+
+	VkMemoryAllocateInfo memoryAllocInfo = {};
+	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocInfo.pNext = &dedicatedInfo;
+	memoryAllocInfo.allocationSize = requirements.size;
+	memoryAllocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkResult result = vkAllocateMemory(device, &memoryAllocInfo, HostAllocator::getCallbacks(), &allocation->memory);
+	if(result != VK_SUCCESS)
+	{
+		//Out of memory on this heap, the caller tries the next memory type
+		allocation->memory = VK_NULL_HANDLE;
+		return false;
+	}
+
+	allocation->offset = 0;
+	allocation->size = requirements.size;
+	allocation->memoryTypeIndex = memoryTypeIndex;
+	allocation->dedicated = true;
+	allocation->mappedData = mapIfHostVisible(allocation->memory, memoryTypeIndex, requirements.size);
+
+	uint32_t heapIndex = getHeapIndex(memoryTypeIndex);
+	dedicatedCount[heapIndex]++;
+	dedicatedBytes[heapIndex] += requirements.size;
+	heapUsage[heapIndex] += requirements.size;
+
+	return true;
+}
+
+bool DeviceAllocator::allocateFromBlock(MemoryBlock& block, uint32_t order, VkDeviceSize* offset)
+{
+	//Smallest free node that fits
+	uint32_t freeOrder = order;
+	while(freeOrder < block.freeLists.size() && block.freeLists[freeOrder].empty())
+	{
+		freeOrder++;
+	}
+	if(freeOrder == block.freeLists.size())
+	{
+		return false;
+	}
+
+	VkDeviceSize nodeOffset = *block.freeLists[freeOrder].begin();
+	block.freeLists[freeOrder].erase(block.freeLists[freeOrder].begin());
+
+	//Split it down to the requested order, the upper halves become free buddies
+	while(freeOrder > order)
+	{
+		freeOrder--;
+		block.freeLists[freeOrder].insert(nodeOffset + (MIN_NODE_SIZE << freeOrder));
+	}
+
+	block.allocatedOrders[nodeOffset] = order;
+	block.usedBytes += MIN_NODE_SIZE << order;
+	block.allocationCount++;
+
+	*offset = nodeOffset;
+	return true;
+}
+
+void DeviceAllocator::freeFromBlock(MemoryBlock& block, VkDeviceSize offset)
+{
+	auto allocated = block.allocatedOrders.find(offset);
+	if(allocated == block.allocatedOrders.end())
+	{
+		throw std::runtime_error("Freeing device memory that was not allocated!");
+	}
+	uint32_t order = allocated->second;
+	block.allocatedOrders.erase(allocated);
+	block.usedBytes -= MIN_NODE_SIZE << order;
+	block.allocationCount--;
+
+	//Merge with the buddy while it is free too
+	while(order + 1 < block.freeLists.size())
+	{
+		VkDeviceSize buddy = offset ^ (MIN_NODE_SIZE << order);
+		auto buddyNode = block.freeLists[order].find(buddy);
+		if(buddyNode == block.freeLists[order].end())
+		{
+			break;
+		}
+		block.freeLists[order].erase(buddyNode);
+		offset = std::min(offset, buddy);
+		order++;
+	}
+	block.freeLists[order].insert(offset);
+}
+
+std::unique_ptr<DeviceAllocator::MemoryBlock> DeviceAllocator::createBlock(const MemoryPool& pool)
+{
+	std::unique_ptr<MemoryBlock> block(new MemoryBlock());
+
+	VkMemoryAllocateInfo memoryAllocInfo = {};
+	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocInfo.allocationSize = pool.blockSize;
+	memoryAllocInfo.memoryTypeIndex = pool.memoryTypeIndex;
+
+	VkResult result = vkAllocateMemory(device, &memoryAllocInfo, HostAllocator::getCallbacks(), &block->memory);
+	if(result != VK_SUCCESS)
+	{
+		return nullptr;
+	}
+	heapUsage[getHeapIndex(pool.memoryTypeIndex)] += pool.blockSize;
+
+	//Whole block starts as one free node
+	block->freeLists.resize(pool.maxOrder + 1);
+	block->freeLists[pool.maxOrder].insert(0);
+	block->mappedData = mapIfHostVisible(block->memory, pool.memoryTypeIndex, pool.blockSize);
+
+	return block;
+}
+
+void DeviceAllocator::destroyBlock(const MemoryPool& pool, MemoryBlock& block)
+{
+	vkFreeMemory(device, block.memory, HostAllocator::getCallbacks());
+	uint32_t heapIndex = getHeapIndex(pool.memoryTypeIndex);
+	heapUsage[heapIndex] -= std::min(heapUsage[heapIndex], pool.blockSize);
+	block.memory = VK_NULL_HANDLE;
+	block.mappedData = nullptr;
+}
+
+std::vector<uint32_t> DeviceAllocator::findMemoryTypes(uint32_t allowedTypes, VkMemoryPropertyFlags properties)
+{
+	std::vector<uint32_t> memoryTypes;
+	for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+	{
+		if((allowedTypes & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			memoryTypes.push_back(i);
+		}
+	}
+
+	//Device local is a preference: slower host memory the GPU reads over the bus beats failing when VRAM is full
+	if(properties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+	{
+		VkMemoryPropertyFlags fallbackProperties = properties & ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		{
+			if((allowedTypes & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & fallbackProperties) == fallbackProperties
+				&& std::find(memoryTypes.begin(), memoryTypes.end(), i) == memoryTypes.end())
+			{
+				memoryTypes.push_back(i);
+			}
+		}
+	}
+
+	if(memoryTypes.empty())
+	{
+		throw std::runtime_error("Failed to find a suitable memory type!");
+	}
+	return memoryTypes;
+}
+
+uint32_t DeviceAllocator::getHeapIndex(uint32_t memoryTypeIndex)
+{
+	return memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+}
+
+bool DeviceAllocator::fitsBudget(uint32_t heapIndex, VkDeviceSize size)
+{
+	return heapUsage[heapIndex] + size <= heapBudget[heapIndex];
+}
+
+uint32_t DeviceAllocator::getPoolIndex(uint32_t memoryTypeIndex, bool linear)
+{
+	for(uint32_t i = 0; i < pools.size(); i++)
+	{
+		if(pools[i].memoryTypeIndex == memoryTypeIndex && pools[i].linear == linear)
+		{
+			return i;
+		}
+	}
+
+	//First use of this memory type: blocks are at most 1/8 of the heap (small heaps, e.g. the 256MB host visible VRAM window)
+	MemoryPool pool;
+	pool.memoryTypeIndex = memoryTypeIndex;
+	pool.linear = linear;
+	pool.blockSize = blockSize;
+	VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+	while(pool.blockSize > MIN_NODE_SIZE && pool.blockSize > heapSize / 8)
+	{
+		pool.blockSize >>= 1;
+	}
+	pool.maxOrder = 0;
+	while((MIN_NODE_SIZE << pool.maxOrder) < pool.blockSize)
+	{
+		pool.maxOrder++;
+	}
+
+	pools.push_back(std::move(pool));
+	return static_cast<uint32_t>(pools.size() - 1);
+}
+
+void* DeviceAllocator::mapIfHostVisible(VkDeviceMemory memory, uint32_t memoryTypeIndex, VkDeviceSize size)
+{
+	if(!(memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+	{
+		return nullptr;
+	}
+
+	//Memory can only be mapped once, so map it for its whole lifetime and hand out pointers at offsets
+	void* data;
+	VkResult result = vkMapMemory(device, memory, 0, size, 0, &data);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to map device memory!");
+	}
+	return data;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+#include <array>
+#include <set>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include "HostAllocator.h"
+
+//What an allocation is used for, usage is tracked per heap and category
+enum DeviceMemoryCategory {
+	MEMORY_CATEGORY_MESHES,
+	MEMORY_CATEGORY_TEXTURES,
+	MEMORY_CATEGORY_UNIFORMS,
+	MEMORY_CATEGORY_ATTACHMENTS,
+	MEMORY_CATEGORY_STAGING,
+	MEMORY_CATEGORY_OTHER,
+	MEMORY_CATEGORY_COUNT
+};
+
+//Piece of device memory owned by one buffer/image
+//Sub-allocations share the VkDeviceMemory of their block, so always bind/map at offset
+struct DeviceAllocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;				//Size reserved (buddy node size or dedicated size)
+	void* mappedData = nullptr;			//Host visible memory is mapped for its whole lifetime, already at offset
+
+	uint32_t memoryTypeIndex = 0;
+	uint32_t poolIndex = 0;
+	uint32_t blockIndex = 0;
+	bool dedicated = false;
+	DeviceMemoryCategory category = MEMORY_CATEGORY_OTHER;
+};
+
+//Memory usage of one heap
+struct DeviceHeapStats {
+	VkDeviceSize heapSize = 0;
+	uint32_t blockCount = 0;
+	VkDeviceSize blockBytes = 0;			//Reserved by blocks
+	uint32_t allocationCount = 0;
+	VkDeviceSize usedBytes = 0;				//Handed out of blocks (rounded to buddy node sizes)
+	uint32_t dedicatedCount = 0;
+	VkDeviceSize dedicatedBytes = 0;
+
+	VkDeviceSize budget = 0;				//What this process may use (VK_EXT_memory_budget, else 80% of the heap)
+	VkDeviceSize usage = 0;					//What this process uses, other renderers on the device included (only ours without the extension)
+	std::array<VkDeviceSize, MEMORY_CATEGORY_COUNT> categoryBytes = {};		//Our allocations by category (reserved sizes)
+};
+
+//Reserves large blocks per memory type and splits them with a buddy scheme, instead of one vkAllocateMemory per resource
+//(allocation count is limited by maxMemoryAllocationCount, and every allocation costs driver time)
+//Linear (buffers) and optimal (images) resources get separate blocks, so bufferImageGranularity never applies
+//New device memory is only taken from heaps with room left in their budget, a full heap falls back to the next
+//memory type that fits (for device local requests, host memory the GPU can still read) before giving up
+class DeviceAllocator
+{
+public:
+	static const VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+	static const VkDeviceSize MIN_NODE_SIZE = 256;
+
+	DeviceAllocator();
+
+	//memoryBudgetSupported: VK_EXT_memory_budget is enabled on the device
+	void create(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, bool newMemoryBudgetSupported,
+		VkDeviceSize newBlockSize = DEFAULT_BLOCK_SIZE);
+	//Every allocation must be freed before
+	void destroy();
+
+	//Allocate and bind memory for the resource (dedicated if the driver prefers it or it is too big for a block)
+	DeviceAllocation allocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags properties, DeviceMemoryCategory category);
+	DeviceAllocation allocateImageMemory(VkImage image, VkMemoryPropertyFlags properties, DeviceMemoryCategory category);
+	//Memory the caller binds itself (several images aliasing one range), placed like optimal image memory
+	DeviceAllocation allocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+		DeviceMemoryCategory category);
+	void free(DeviceAllocation& allocation);
+
+	//Refresh budget and usage from the driver, once per frame (between calls our own allocations are added in)
+	void updateBudget();
+
+	//Memory both device local and host visible on the main VRAM heap: resizable BAR, or unified memory
+	//(integrated GPUs, lavapipe). Buffers there can be written with memcpy instead of staging + copy
+	bool hasHostVisibleDeviceLocal();
+	//One of the allowed memory types has all the properties (no fallback), e.g. LAZILY_ALLOCATED for transient attachments
+	bool supportsProperties(uint32_t allowedTypes, VkMemoryPropertyFlags properties);
+
+	std::vector<DeviceHeapStats> getHeapStats();
+	static const char* getCategoryName(DeviceMemoryCategory category);
+	//Number of live vkAllocateMemory allocations (blocks + dedicated)
+	uint32_t getDeviceMemoryCount();
+
+	~DeviceAllocator();
+
+private:
+	VkPhysicalDevice physicalDevice;
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE;
+	bool memoryBudgetSupported = false;
+	bool hostVisibleDeviceLocal = false;
+
+	struct MemoryBlock {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void* mappedData = nullptr;
+		VkDeviceSize usedBytes = 0;
+		uint32_t allocationCount = 0;
+		std::vector<std::set<VkDeviceSize>> freeLists;				//Free node offsets per order (node size = MIN_NODE_SIZE << order)
+		std::unordered_map<VkDeviceSize, uint32_t> allocatedOrders;	//Offset of each used node -> its order
+	};
+
+	//Blocks of one memory type for either linear or optimal resources
+	struct MemoryPool {
+		uint32_t memoryTypeIndex;
+		bool linear;
+		VkDeviceSize blockSize;										//Smaller than blockSize on small heaps
+		uint32_t maxOrder;											//Order of a whole block
+		std::vector<std::unique_ptr<MemoryBlock>> blocks;			//Empty slots keep block indices stable
+	};
+	std::vector<MemoryPool> pools;
+
+	std::vector<uint32_t> dedicatedCount;							//Per heap
+	std::vector<VkDeviceSize> dedicatedBytes;						//Per heap
+
+	std::vector<VkDeviceSize> heapBudget;							//Per heap
+	std::vector<VkDeviceSize> heapUsage;							//Per heap, driver value of the last update + our changes since
+	std::vector<std::array<VkDeviceSize, MEMORY_CATEGORY_COUNT>> categoryBytes;		//Per heap
+
+	std::mutex allocatorMutex;
+
+	DeviceAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, DeviceMemoryCategory category,
+		bool linear, bool dedicated, VkBuffer dedicatedBuffer, VkImage dedicatedImage);
+	//False if the memory type has no room (over budget when respectBudget, or the driver refused)
+	bool allocateFromType(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, bool linear, bool dedicated,
+		VkBuffer dedicatedBuffer, VkImage dedicatedImage, bool respectBudget, DeviceAllocation* allocation);
+	bool allocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex,
+		VkBuffer dedicatedBuffer, VkImage dedicatedImage, DeviceAllocation* allocation);
+	bool allocateFromBlock(MemoryBlock& block, uint32_t order, VkDeviceSize* offset);
+	void freeFromBlock(MemoryBlock& block, VkDeviceSize offset);
+	//Null if the driver is out of memory
+	std::unique_ptr<MemoryBlock> createBlock(const MemoryPool& pool);
+	void destroyBlock(const MemoryPool& pool, MemoryBlock& block);
+
+	//Types with all the properties first, then for device local requests the types without it
+	std::vector<uint32_t> findMemoryTypes(uint32_t allowedTypes, VkMemoryPropertyFlags properties);
+	uint32_t getHeapIndex(uint32_t memoryTypeIndex);
+	bool fitsBudget(uint32_t heapIndex, VkDeviceSize size);
+	uint32_t getPoolIndex(uint32_t memoryTypeIndex, bool linear);
+	void* mapIfHostVisible(VkDeviceMemory memory, uint32_t memoryTypeIndex, VkDeviceSize size);
+};
@@ -0,0 +1,212 @@
+#include "FrameContext.h"
+
+FrameContext::FrameContext()
+{
+}
+
+void FrameContext::create(DeviceAllocator* allocator, VkDevice newDevice, uint32_t newQueueFamilyIndex, uint32_t workerCount)
+{
+	device = newDevice;
+	queueFamilyIndex = newQueueFamilyIndex;
+
+	//Primary command buffer pool (TRANSIENT: re-recorded every frame)
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+	VkResult result = vkCreateCommandPool(device, &poolInfo, HostAllocator::getCallbacks(), &commandPool);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create frame command pool!");
+	}
+
+	VkCommandBufferAllocateInfo cbAllocInfo = {};
+	cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cbAllocInfo.commandPool = commandPool;
+	cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cbAllocInfo.commandBufferCount = 1;
+
+	result = vkAllocateCommandBuffers(device, &cbAllocInfo, &commandBuffer);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate frame command buffer!");
+	}
+
+	createWorkers(workerCount);
+
+	//Frame data, mapped for the whole lifetime of the frame
+	ringBuffer.create(allocator, device, FRAME_RING_BUFFER_SIZE,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+
+	//Semaphore creation info
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	if(vkCreateSemaphore(device, &semaphoreCreateInfo, HostAllocator::getCallbacks(), &imageAvailable) != VK_SUCCESS ||
+	vkCreateSemaphore(device, &semaphoreCreateInfo, HostAllocator::getCallbacks(), &renderFinished) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create a Semaphore!");
+	}
+
+	submittedValue = 0;
+	dirty = true;
+}
+
+void FrameContext::destroy()
+{
+	vkDestroySemaphore(device, renderFinished, HostAllocator::getCallbacks());
+	vkDestroySemaphore(device, imageAvailable, HostAllocator::getCallbacks());
+
+	ringBuffer.destroy();
+	destroyWorkers();
+
+	//Destroying the pool frees its command buffer too
+	vkDestroyCommandPool(device, commandPool, HostAllocator::getCallbacks());
+}
+
+void FrameContext::createWorkers(uint32_t workerCount)
+{
+	workers.resize(workerCount);
+	for(auto& worker : workers)
+	{
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;		//Secondary buffers are reset one by one, only when re-recorded
+		poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+		VkResult result = vkCreateCommandPool(device, &poolInfo, HostAllocator::getCallbacks(), &worker.commandPool);
+		if(result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create a record worker command pool!");
+		}
+
+		//Secondary buffer: can't be submitted, it is executed by the primary buffer of this frame
+		VkCommandBufferAllocateInfo cbAllocInfo = {};
+		cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cbAllocInfo.commandPool = worker.commandPool;
+		cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		cbAllocInfo.commandBufferCount = 1;
+
+		result = vkAllocateCommandBuffers(device, &cbAllocInfo, &worker.secondaryCommandBuffer);
+		if(result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate secondary command buffers!");
+		}
+	}
+
+	dirty = true;
+}
+
+void FrameContext::destroyWorkers()
+{
+	for(auto& worker : workers)
+	{
+		vkDestroyCommandPool(device, worker.commandPool, HostAllocator::getCallbacks());
+	}
+	workers.clear();
+}
+
+void FrameContext::beginFrame(TimelineScheduler& timeline)
+{
+	//Only blocks if the GPU is still on the last submit of this frame
+	timeline.wait(submittedValue);
+
+	//GPU is done with this frame: primary buffer and frame data can be rewritten
+	vkResetCommandPool(device, commandPool, 0);
+	ringBuffer.reset();
+}
+
+void FrameContext::setSubmittedValue(uint64_t value)
+{
+	submittedValue = value;
+}
+
+uint64_t FrameContext::getSubmittedValue()
+{
+	return submittedValue;
+}
+
+void FrameContext::setDescriptorSet(VkDescriptorSet newDescriptorSet)
+{
+	descriptorSet = newDescriptorSet;
+}
+
+void FrameContext::setDataOffsets(std::array<uint32_t, 1> newDataOffsets)
+{
+	dataOffsets = newDataOffsets;
+}
+
+void FrameContext::setDrawCommandOffset(VkDeviceSize newDrawCommandOffset)
+{
+	drawCommandOffset = newDrawCommandOffset;
+}
+
+void FrameContext::markDirty()
+{
+	dirty = true;
+}
+
+bool FrameContext::isRecordingValid()
+{
+	//Dynamic offsets and the draw command offset are baked in the secondary buffers
+	return !dirty && recordedDataOffsets == dataOffsets && recordedDrawCommandOffset == drawCommandOffset;
+}
+
+void FrameContext::markRecorded(uint32_t usedSecondaryCount)
+{
+	dirty = false;
+	recordedSecondaryCount = usedSecondaryCount;
+	recordedDataOffsets = dataOffsets;
+	recordedDrawCommandOffset = drawCommandOffset;
+}
+
+VkCommandBuffer FrameContext::getCommandBuffer()
+{
+	return commandBuffer;
+}
+
+VkCommandBuffer FrameContext::getSecondaryCommandBuffer(uint32_t workerIndex)
+{
+	return workers[workerIndex].secondaryCommandBuffer;
+}
+
+uint32_t FrameContext::getRecordedSecondaryCount()
+{
+	return recordedSecondaryCount;
+}
+
+RingBuffer& FrameContext::getRingBuffer()
+{
+	return ringBuffer;
+}
+
+VkDescriptorSet FrameContext::getDescriptorSet()
+{
+	return descriptorSet;
+}
+
+const std::array<uint32_t, 1>& FrameContext::getDataOffsets()
+{
+	return dataOffsets;
+}
+
+VkDeviceSize FrameContext::getDrawCommandOffset()
+{
+	return drawCommandOffset;
+}
+
+VkSemaphore FrameContext::getImageAvailable()
+{
+	return imageAvailable;
+}
+
+VkSemaphore FrameContext::getRenderFinished()
+{
+	return renderFinished;
+}
+
+FrameContext::~FrameContext()
+{
+}
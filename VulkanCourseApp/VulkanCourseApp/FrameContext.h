@@ -0,0 +1,85 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+#include <array>
+
+#include "Utilities.h"
+#include "RingBuffer.h"
+#include "TimelineScheduler.h"
+
+//Everything one frame in flight writes to: command buffers, frame data, descriptor set and synchronization
+//A frame context is reused only after the timeline reached its last submit, so nothing in it is shared with another frame on the GPU
+class FrameContext
+{
+public:
+	FrameContext();
+
+	void create(DeviceAllocator* allocator, VkDevice newDevice, uint32_t queueFamilyIndex, uint32_t workerCount);
+	void destroy();
+
+	//One pool + secondary command buffer per recording thread (pools can't be used by two threads at once)
+	void createWorkers(uint32_t workerCount);
+	void destroyWorkers();
+
+	//Wait for the last submit of this frame, then recycle its primary command buffer and frame data
+	void beginFrame(TimelineScheduler& timeline);
+	//Timeline value signalled by the last submit of this frame
+	void setSubmittedValue(uint64_t value);
+	uint64_t getSubmittedValue();
+
+	void setDescriptorSet(VkDescriptorSet newDescriptorSet);
+	void setDataOffsets(std::array<uint32_t, 1> newDataOffsets);
+	//Where this frame's indirect draw commands are in the ring
+	void setDrawCommandOffset(VkDeviceSize newDrawCommandOffset);
+
+	//Secondary buffers are kept until something structural changes or the frame data moved
+	void markDirty();
+	bool isRecordingValid();
+	void markRecorded(uint32_t usedSecondaryCount);
+
+	VkCommandBuffer getCommandBuffer();
+	VkCommandBuffer getSecondaryCommandBuffer(uint32_t workerIndex);
+	uint32_t getRecordedSecondaryCount();
+	RingBuffer& getRingBuffer();
+	VkDescriptorSet getDescriptorSet();
+	const std::array<uint32_t, 1>& getDataOffsets();
+	VkDeviceSize getDrawCommandOffset();
+	VkSemaphore getImageAvailable();
+	VkSemaphore getRenderFinished();
+
+	~FrameContext();
+
+private:
+	VkDevice device;
+	uint32_t queueFamilyIndex;
+
+	//-Commands
+	VkCommandPool commandPool;					//Primary buffer only, reset as a whole every frame
+	VkCommandBuffer commandBuffer;
+
+	struct WorkerCommands {
+		VkCommandPool commandPool;
+		VkCommandBuffer secondaryCommandBuffer;
+	};
+	std::vector<WorkerCommands> workers;
+
+	bool dirty = true;
+	uint32_t recordedSecondaryCount = 0;
+	std::array<uint32_t, 1> recordedDataOffsets = {0};
+	VkDeviceSize recordedDrawCommandOffset = 0;
+
+	//-Frame data (dynamic offset of VP data inside the ring, instance data has its own buffer)
+	RingBuffer ringBuffer;
+	std::array<uint32_t, 1> dataOffsets = {0};
+	VkDeviceSize drawCommandOffset = 0;
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;		//Owned by the renderer descriptor pool
+
+	//-Syncronization (binary semaphores only for acquire/present, GPU progress is on the timeline)
+	VkSemaphore imageAvailable;
+	VkSemaphore renderFinished;
+	uint64_t submittedValue = 0;		//0: never submitted, always complete
+};
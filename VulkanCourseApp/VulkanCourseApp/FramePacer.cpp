@@ -0,0 +1,149 @@
+#include "FramePacer.h"
+
+#include "Tracer.h"
+
+FramePacer::FramePacer()
+{
+}
+
+void FramePacer::setPolicy(PresentPolicy newPolicy, double newTargetFps)
+{
+	policy = newPolicy;
+	targetFps = std::max(1.0, newTargetFps);
+
+	//Old estimates belong to another present mode
+	refreshIntervalEstimate = 0.0;
+	started = false;
+}
+
+PresentPolicy FramePacer::getPolicy()
+{
+	return policy;
+}
+
+void FramePacer::waitForFrameStart()
+{
+	Clock::time_point now = Clock::now();
+	double targetInterval = getTargetInterval();
+
+	if(started && targetInterval > 0.0)
+	{
+		//Start as late as possible: the deadline minus the CPU time the frame is expected to take (+ margin)
+		double leadTime = cpuTimeEstimate * 1.2 + 0.5;
+		Clock::time_point wakeTime = nextDeadline - std::chrono::duration_cast<Clock::duration>(
+			std::chrono::duration<double, std::milli>(leadTime));
+
+		TRACE_SCOPE("Frame pacing sleep");
+
+		//Sleep is coarse (scheduler tick), sleep most of the way and spin the last millisecond
+		Clock::time_point sleepUntil = wakeTime - std::chrono::milliseconds(1);
+		if(sleepUntil > now)
+		{
+			std::this_thread::sleep_until(sleepUntil);
+		}
+		while(Clock::now() < wakeTime)
+		{
+			std::this_thread::yield();
+		}
+		now = Clock::now();
+	}
+
+	if(started)
+	{
+		currentTiming.frameInterval = toMilliseconds(now - frameStart);
+
+		//Under FIFO the loop ends up locked to vblank, so the frame interval measures the refresh rate
+		if(policy == PresentPolicy::StrictFifo)
+		{
+			refreshIntervalEstimate = refreshIntervalEstimate == 0.0 ? currentTiming.frameInterval
+				: refreshIntervalEstimate * 0.95 + currentTiming.frameInterval * 0.05;
+		}
+	}
+	frameStart = now;
+
+	//Next deadline one interval after the previous one (resync if we fell behind)
+	std::chrono::duration<double, std::milli> interval(targetInterval);
+	Clock::duration step = std::chrono::duration_cast<Clock::duration>(interval);
+	if(!started || nextDeadline + step < now)
+	{
+		nextDeadline = now + step;
+	}
+	else
+	{
+		nextDeadline += step;
+	}
+	started = true;
+}
+
+void FramePacer::markSubmit()
+{
+	submitTime = Clock::now();
+	currentTiming.cpuTime = toMilliseconds(submitTime - frameStart);
+	cpuTimeEstimate = cpuTimeEstimate == 0.0 ? currentTiming.cpuTime : cpuTimeEstimate * 0.9 + currentTiming.cpuTime * 0.1;
+}
+
+void FramePacer::markPresent()
+{
+	currentTiming.submitToPresent = toMilliseconds(Clock::now() - submitTime);
+
+	if(history.size() < HISTORY_SIZE)
+	{
+		history.push_back(currentTiming);
+	}
+	else
+	{
+		history[historyNext] = currentTiming;
+	}
+	historyNext = (historyNext + 1) % HISTORY_SIZE;
+}
+
+FrameTiming FramePacer::getLastFrameTiming()
+{
+	return currentTiming;
+}
+
+FrameTimingStats FramePacer::getStats()
+{
+	FrameTimingStats stats = {};
+	stats.frameCount = static_cast<uint32_t>(history.size());
+	stats.targetInterval = getTargetInterval();
+	if(history.empty()) return stats;
+
+	for(const auto& timing : history)
+	{
+		stats.avgFrameInterval += timing.frameInterval;
+		stats.maxFrameInterval = std::max(stats.maxFrameInterval, timing.frameInterval);
+		stats.avgCpuTime += timing.cpuTime;
+		stats.avgSubmitToPresent += timing.submitToPresent;
+		stats.maxSubmitToPresent = std::max(stats.maxSubmitToPresent, timing.submitToPresent);
+	}
+	stats.avgFrameInterval /= history.size();
+	stats.avgCpuTime /= history.size();
+	stats.avgSubmitToPresent /= history.size();
+
+	return stats;
+}
+
+double FramePacer::getTargetInterval()
+{
+	switch(policy)
+	{
+	case PresentPolicy::PowerSaving:
+		return 1000.0 / targetFps;
+	case PresentPolicy::StrictFifo:
+		//Slightly under the refresh: FIFO blocking sets the real cadence, pacing only removes the queueing
+		//(pacing at or over it would let a hitch drag the estimate up for good)
+		return refreshIntervalEstimate * 0.95;	//0 until measured: first frames run unpaced
+	default:
+		return 0.0;								//Low latency: never hold a frame back
+	}
+}
+
+double FramePacer::toMilliseconds(Clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+FramePacer::~FramePacer()
+{
+}
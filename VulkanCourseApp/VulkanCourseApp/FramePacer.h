@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+//How frames are handed to the display
+enum class PresentPolicy {
+	LowLatency,			//IMMEDIATE (tearing) or MAILBOX, no frame cap
+	PowerSaving,		//FIFO, capped to a target FPS
+	StrictFifo			//FIFO, paced to the measured refresh interval
+};
+
+//Per frame CPU timings (milliseconds)
+struct FrameTiming {
+	double frameInterval;			//Start of previous frame to start of this frame
+	double cpuTime;					//Frame start to queue submit
+	double submitToPresent;			//Queue submit to vkQueuePresentKHR returning (includes present blocking in FIFO)
+};
+
+struct FrameTimingStats {
+	uint32_t frameCount;
+	double targetInterval;			//0: uncapped
+	double avgFrameInterval, maxFrameInterval;
+	double avgCpuTime;
+	double avgSubmitToPresent, maxSubmitToPresent;
+};
+
+//Delays the start of each frame so its CPU work finishes right when the next slot is due,
+//instead of running ahead and then waiting in acquire/present with stale input
+class FramePacer
+{
+public:
+	FramePacer();
+
+	void setPolicy(PresentPolicy newPolicy, double newTargetFps);
+	PresentPolicy getPolicy();
+
+	//Sleep until the next frame should start, then mark it started
+	void waitForFrameStart();
+	void markSubmit();
+	void markPresent();
+
+	FrameTiming getLastFrameTiming();
+	//Over the last HISTORY_SIZE frames
+	FrameTimingStats getStats();
+
+	~FramePacer();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	static const size_t HISTORY_SIZE = 120;
+
+	PresentPolicy policy = PresentPolicy::LowLatency;
+	double targetFps = 30.0;
+
+	Clock::time_point frameStart;
+	Clock::time_point submitTime;
+	Clock::time_point nextDeadline;		//When the next submit is due
+	bool started = false;
+
+	//Exponential moving averages used to place the next frame start
+	double cpuTimeEstimate = 0.0;			//ms
+	double refreshIntervalEstimate = 0.0;	//ms, from frame intervals under FIFO
+
+	FrameTiming currentTiming = {};
+	std::vector<FrameTiming> history;		//Ring of the last frames
+	size_t historyNext = 0;
+
+	double getTargetInterval();
+	static double toMilliseconds(Clock::duration duration);
+};
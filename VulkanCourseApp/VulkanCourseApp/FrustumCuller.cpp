@@ -0,0 +1,114 @@
+#include "FrustumCuller.h"
+
+#ifdef __AVX__
+static const size_t SIMD_WIDTH = 8;
+#else
+static const size_t SIMD_WIDTH = 4;
+#endif
+
+FrustumCuller::FrustumCuller()
+{
+}
+
+void FrustumCuller::setFrustum(const glm::mat4& viewProjection)
+{
+	extractFrustumPlanes(viewProjection, planes);
+}
+
+void FrustumCuller::clear()
+{
+	//Capacity is kept, packing the next frame allocates nothing
+	centreX.clear();
+	centreY.clear();
+	centreZ.clear();
+	radius.clear();
+	sphereCount = 0;
+}
+
+void FrustumCuller::addSphere(glm::vec3 centre, float sphereRadius)
+{
+	centreX.push_back(centre.x);
+	centreY.push_back(centre.y);
+	centreZ.push_back(centre.z);
+	radius.push_back(sphereRadius);
+	sphereCount++;
+}
+
+size_t FrustumCuller::getSphereCount()
+{
+	return sphereCount;
+}
+
+void FrustumCuller::cull()
+{
+	//Pad to a whole number of SIMD blocks, padding spheres are never reported
+	size_t paddedCount = (sphereCount + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+	centreX.resize(paddedCount, 0.0f);
+	centreY.resize(paddedCount, 0.0f);
+	centreZ.resize(paddedCount, 0.0f);
+	radius.resize(paddedCount, 0.0f);
+	visible.resize(paddedCount);
+
+	for(size_t i = 0; i < paddedCount; i += SIMD_WIDTH)
+	{
+#ifdef __AVX__
+		__m256 x = _mm256_loadu_ps(&centreX[i]);
+		__m256 y = _mm256_loadu_ps(&centreY[i]);
+		__m256 z = _mm256_loadu_ps(&centreZ[i]);
+		__m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radius[i]));
+
+		//Outside as soon as one plane has the whole sphere behind it
+		__m256 outside = _mm256_setzero_ps();
+		for(const glm::vec4& plane : planes)
+		{
+			__m256 distance = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+				_mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, negRadius, _CMP_LT_OQ));
+		}
+		int outsideMask = _mm256_movemask_ps(outside);
+#else
+		__m128 x = _mm_loadu_ps(&centreX[i]);
+		__m128 y = _mm_loadu_ps(&centreY[i]);
+		__m128 z = _mm_loadu_ps(&centreZ[i]);
+		__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+
+		//Outside as soon as one plane has the whole sphere behind it
+		__m128 outside = _mm_setzero_ps();
+		for(const glm::vec4& plane : planes)
+		{
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negRadius));
+		}
+		int outsideMask = _mm_movemask_ps(outside);
+#endif
+
+		for(size_t j = 0; j < SIMD_WIDTH; j++)
+		{
+			visible[i + j] = (outsideMask & (1 << j)) == 0;
+		}
+	}
+
+	stats.visibleCount = 0;
+	for(size_t i = 0; i < sphereCount; i++)
+	{
+		stats.visibleCount += visible[i];
+	}
+	stats.culledCount = static_cast<uint32_t>(sphereCount) - stats.visibleCount;
+}
+
+bool FrustumCuller::isVisible(size_t sphereIndex)
+{
+	return visible[sphereIndex] != 0;
+}
+
+CullStats FrustumCuller::getStats()
+{
+	return stats;
+}
+
+FrustumCuller::~FrustumCuller()
+{
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+//SSE2 is always there on x64, AVX only when the compiler targets it (/arch:AVX)
+#include <emmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include "Utilities.h"
+
+//Result of the last cull
+struct CullStats {
+	uint32_t visibleCount = 0;
+	uint32_t culledCount = 0;
+};
+
+//Frustum culling on the CPU, for devices that can't cull on the GPU
+//World space spheres are packed SoA (x, y, z, radius arrays, padded to the SIMD width) so every plane test
+//runs on 4 (SSE) or 8 (AVX) spheres at once
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	void setFrustum(const glm::mat4& viewProjection);
+
+	//Spheres for the next cull, in the order results are reported
+	void clear();
+	void addSphere(glm::vec3 centre, float radius);
+	size_t getSphereCount();
+
+	//Test every sphere, isVisible(i) tells the result of the i-th one added
+	void cull();
+	bool isVisible(size_t sphereIndex);
+	CullStats getStats();
+
+	~FrustumCuller();
+
+private:
+	glm::vec4 planes[6];
+
+	std::vector<float> centreX;
+	std::vector<float> centreY;
+	std::vector<float> centreZ;
+	std::vector<float> radius;
+	size_t sphereCount = 0;
+
+	std::vector<uint8_t> visible;
+	CullStats stats;
+};
@@ -0,0 +1,180 @@
+#include "GeometryPool.h"
+
+void FreeListAllocator::reset(uint32_t newCapacity)
+{
+	capacity = newCapacity;
+	used = 0;
+	freeRanges.clear();
+	freeRanges[0] = capacity;
+}
+
+uint32_t FreeListAllocator::allocate(uint32_t size)
+{
+	if(size == 0) return 0;
+
+	for(auto range = freeRanges.begin(); range != freeRanges.end(); ++range)
+	{
+		if(range->second < size) continue;
+
+		//Take the front of the range, the rest stays free
+		uint32_t offset = range->first;
+		uint32_t remaining = range->second - size;
+		freeRanges.erase(range);
+		if(remaining > 0)
+		{
+			freeRanges[offset + size] = remaining;
+		}
+
+		used += size;
+		return offset;
+	}
+
+	return INVALID_OFFSET;
+}
+
+void FreeListAllocator::release(uint32_t offset, uint32_t size)
+{
+	if(size == 0) return;
+
+	used -= size;
+
+	//Merge with the following free range
+	auto next = freeRanges.find(offset + size);
+	if(next != freeRanges.end())
+	{
+		size += next->second;
+		freeRanges.erase(next);
+	}
+
+	//Merge with the preceding free range
+	auto inserted = freeRanges.emplace(offset, size).first;
+	if(inserted != freeRanges.begin())
+	{
+		auto previous = std::prev(inserted);
+		if(previous->first + previous->second == offset)
+		{
+			previous->second += size;
+			freeRanges.erase(inserted);
+		}
+	}
+}
+
+uint32_t FreeListAllocator::getCapacity()
+{
+	return capacity;
+}
+
+uint32_t FreeListAllocator::getUsed()
+{
+	return used;
+}
+
+GeometryPool::GeometryPool()
+{
+}
+
+void GeometryPool::create(DeviceAllocator* newAllocator, VkDevice newDevice, uint32_t newVertexCapacity, uint32_t newIndexCapacity,
+	bool newDirectWrites)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	directWrites = newDirectWrites;
+
+	//Device local, filled through staging copies, or also host visible (and kept mapped) to be written directly
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	if(directWrites)
+	{
+		properties |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	}
+
+	createBuffer(*allocator, device, sizeof(Vertex) * (VkDeviceSize)newVertexCapacity,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		properties, &vertexBuffer, &vertexBufferAllocation, MEMORY_CATEGORY_MESHES);
+	vertexRanges.reset(newVertexCapacity);
+
+	createBuffer(*allocator, device, sizeof(uint32_t) * (VkDeviceSize)newIndexCapacity,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		properties, &indexBuffer, &indexBufferAllocation, MEMORY_CATEGORY_MESHES);
+	indexRanges.reset(newIndexCapacity);
+}
+
+void GeometryPool::destroy()
+{
+	if(vertexBuffer == VK_NULL_HANDLE) return;
+
+	destroyBuffer(*allocator, device, vertexBuffer, &vertexBufferAllocation);
+	destroyBuffer(*allocator, device, indexBuffer, &indexBufferAllocation);
+	vertexBuffer = VK_NULL_HANDLE;
+	indexBuffer = VK_NULL_HANDLE;
+}
+
+GeometryRange GeometryPool::upload(UploadManager& uploads, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	GeometryRange range;
+	range.vertexCount = static_cast<uint32_t>(vertices.size());
+	range.indexCount = static_cast<uint32_t>(indices.size());
+
+	range.vertexOffset = vertexRanges.allocate(range.vertexCount);
+	if(range.vertexOffset == FreeListAllocator::INVALID_OFFSET)
+	{
+		throw std::runtime_error("Geometry pool out of vertex space!");
+	}
+	range.firstIndex = indexRanges.allocate(range.indexCount);
+	if(range.firstIndex == FreeListAllocator::INVALID_OFFSET)
+	{
+		vertexRanges.release(range.vertexOffset, range.vertexCount);
+		throw std::runtime_error("Geometry pool out of index space!");
+	}
+
+	//Mapped and coherent: no GPU copy needed (host memory if the budget fallback moved it out of VRAM, still fine)
+	//The ranges are new, so the GPU is not reading them, and coherent writes are visible to the next submit
+	if(usesDirectWrites())
+	{
+		memcpy(static_cast<Vertex*>(vertexBufferAllocation.mappedData) + range.vertexOffset, vertices.data(),
+			sizeof(Vertex) * range.vertexCount);
+		memcpy(static_cast<uint32_t*>(indexBufferAllocation.mappedData) + range.firstIndex, indices.data(),
+			sizeof(uint32_t) * range.indexCount);
+		return range;
+	}
+
+	//Both copies go into the current upload batch, into their ranges of the pool buffers
+	uploads.uploadBuffer(vertexBuffer, sizeof(Vertex) * (VkDeviceSize)range.vertexOffset,
+		vertices.data(), sizeof(Vertex) * (VkDeviceSize)range.vertexCount);
+	uploads.uploadBuffer(indexBuffer, sizeof(uint32_t) * (VkDeviceSize)range.firstIndex,
+		indices.data(), sizeof(uint32_t) * (VkDeviceSize)range.indexCount);
+
+	return range;
+}
+
+void GeometryPool::free(const GeometryRange& range)
+{
+	vertexRanges.release(range.vertexOffset, range.vertexCount);
+	indexRanges.release(range.firstIndex, range.indexCount);
+}
+
+void GeometryPool::bind(VkCommandBuffer commandBuffer)
+{
+	VkBuffer vertexBuffers[] = {vertexBuffer};
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+VkBuffer GeometryPool::getVertexBuffer()
+{
+	return vertexBuffer;
+}
+
+VkBuffer GeometryPool::getIndexBuffer()
+{
+	return indexBuffer;
+}
+
+bool GeometryPool::usesDirectWrites()
+{
+	return directWrites && vertexBufferAllocation.mappedData != nullptr && indexBufferAllocation.mappedData != nullptr;
+}
+
+GeometryPool::~GeometryPool()
+{
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+#include <map>
+#include <iterator>
+
+#include "Utilities.h"
+#include "UploadManager.h"
+
+//Where a mesh lives in the geometry pool (in vertices/indices, not bytes)
+//Draw with vkCmdDrawIndexed(indexCount, ..., firstIndex, vertexOffset, ...): indices stay local to the mesh
+struct GeometryRange {
+	uint32_t vertexOffset = 0;
+	uint32_t vertexCount = 0;
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+};
+
+//First fit free list over [0, capacity), neighbouring free ranges are merged on release
+class FreeListAllocator
+{
+public:
+	static const uint32_t INVALID_OFFSET = ~0u;
+
+	void reset(uint32_t newCapacity);
+
+	//Returns INVALID_OFFSET when no free range is big enough
+	uint32_t allocate(uint32_t size);
+	void release(uint32_t offset, uint32_t size);
+
+	uint32_t getCapacity();
+	uint32_t getUsed();
+
+private:
+	uint32_t capacity = 0;
+	uint32_t used = 0;
+	std::map<uint32_t, uint32_t> freeRanges;		//Offset -> size, ordered so neighbours are found in O(log n)
+};
+
+//One device local vertex buffer and one index buffer shared by every mesh
+//Binding them once per command buffer replaces the per mesh vertex/index buffer binds
+//With host visible device local memory (resizable BAR, unified memory) mesh data is written in place, no staging copy
+class GeometryPool
+{
+public:
+	GeometryPool();
+
+	void create(DeviceAllocator* newAllocator, VkDevice newDevice, uint32_t newVertexCapacity, uint32_t newIndexCapacity,
+		bool newDirectWrites);
+	void destroy();
+
+	//Reserve space and queue the mesh data copy into it (drawable once the upload ticket is complete)
+	//Direct writes: copied right away, drawable by any submit after the call
+	GeometryRange upload(UploadManager& uploads, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+	//Only call once the GPU no longer draws the range
+	void free(const GeometryRange& range);
+
+	//Bind both buffers, every draw then only passes its range
+	void bind(VkCommandBuffer commandBuffer);
+
+	VkBuffer getVertexBuffer();
+	VkBuffer getIndexBuffer();
+	bool usesDirectWrites();
+
+	~GeometryPool();
+
+private:
+	DeviceAllocator* allocator;
+	VkDevice device;
+	bool directWrites = false;
+
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	DeviceAllocation vertexBufferAllocation;
+	FreeListAllocator vertexRanges;
+
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	DeviceAllocation indexBufferAllocation;
+	FreeListAllocator indexRanges;
+};
@@ -0,0 +1,169 @@
+#include "GpuProfiler.h"
+
+GpuProfiler::GpuProfiler()
+{
+}
+
+void GpuProfiler::create(VkPhysicalDevice physicalDevice, VkDevice newDevice, uint32_t queueFamilyIndex,
+	uint32_t newFrameCount, bool hostQueryReset, uint32_t newMaxScopesPerFrame)
+{
+	device = newDevice;
+	frameCount = newFrameCount;
+	maxScopesPerFrame = newMaxScopesPerFrame;
+	currentFrame = 0;
+	frameScopes.assign(frameCount, std::vector<std::string>());
+
+	//Timestamps are only supported if the queue family has valid bits
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilyList(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyList.data());
+
+	uint32_t validBits = queueFamilyList[queueFamilyIndex].timestampValidBits;
+	enabled = validBits > 0 && hostQueryReset;
+	if(!enabled)
+	{
+		return;
+	}
+	timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	timestampPeriod = deviceProperties.limits.timestampPeriod;
+
+	VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+	queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolCreateInfo.queryCount = frameCount * maxScopesPerFrame * 2;
+
+	VkResult result = vkCreateQueryPool(device, &queryPoolCreateInfo, HostAllocator::getCallbacks(), &queryPool);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create timestamp query pool!");
+	}
+
+	//Queries must be reset before their first use, done from the host so no command buffer is needed
+	vkResetQueryPool(device, queryPool, 0, queryPoolCreateInfo.queryCount);
+}
+
+void GpuProfiler::destroy()
+{
+	if(queryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(device, queryPool, HostAllocator::getCallbacks());
+		queryPool = VK_NULL_HANDLE;
+	}
+	enabled = false;
+}
+
+void GpuProfiler::beginFrame(uint32_t frameIndex)
+{
+	if(!enabled) return;
+
+	std::lock_guard<std::mutex> lock(profilerMutex);
+
+	collectResults(frameIndex);
+
+	vkResetQueryPool(device, queryPool, getFirstQuery(frameIndex), maxScopesPerFrame * 2);
+	frameScopes[frameIndex].clear();
+	currentFrame = frameIndex;
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const std::string& name)
+{
+	if(!enabled) return INVALID_SCOPE;
+
+	std::lock_guard<std::mutex> lock(profilerMutex);
+
+	//Out of queries for this frame: scope is dropped
+	std::vector<std::string>& scopes = frameScopes[currentFrame];
+	if(scopes.size() >= maxScopesPerFrame)
+	{
+		return INVALID_SCOPE;
+	}
+
+	uint32_t scope = currentFrame * maxScopesPerFrame + static_cast<uint32_t>(scopes.size());
+	scopes.push_back(name);
+
+	//TOP_OF_PIPE: written as soon as previous commands started
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, scope * 2);
+
+	return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope)
+{
+	if(!enabled || scope == INVALID_SCOPE) return;
+
+	//BOTTOM_OF_PIPE: written once all previous commands completed
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, scope * 2 + 1);
+}
+
+std::vector<GpuScopeStats> GpuProfiler::getStats()
+{
+	std::lock_guard<std::mutex> lock(profilerMutex);
+
+	std::vector<GpuScopeStats> stats;
+	for(const auto& accumulator : accumulators)
+	{
+		GpuScopeStats scopeStats = {};
+		scopeStats.name = accumulator.first;
+		scopeStats.count = accumulator.second.count;
+		scopeStats.minMs = accumulator.second.minMs;
+		scopeStats.avgMs = accumulator.second.totalMs / accumulator.second.count;
+		scopeStats.maxMs = accumulator.second.maxMs;
+		stats.push_back(scopeStats);
+	}
+
+	return stats;
+}
+
+void GpuProfiler::resetStats()
+{
+	std::lock_guard<std::mutex> lock(profilerMutex);
+	accumulators.clear();
+}
+
+bool GpuProfiler::isEnabled()
+{
+	return enabled;
+}
+
+void GpuProfiler::collectResults(uint32_t frameIndex)
+{
+	std::vector<std::string>& scopes = frameScopes[frameIndex];
+	if(scopes.empty()) return;
+
+	//Value + availability for each query, no WAIT flag: a scope that never ran is just skipped
+	uint32_t queryCount = static_cast<uint32_t>(scopes.size()) * 2;
+	std::vector<uint64_t> results(queryCount * 2);
+	vkGetQueryPoolResults(device, queryPool, getFirstQuery(frameIndex), queryCount,
+		results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	for(size_t i = 0; i < scopes.size(); i++)
+	{
+		uint64_t begin = results[i * 4];
+		bool beginAvailable = results[i * 4 + 1] != 0;
+		uint64_t end = results[i * 4 + 2];
+		bool endAvailable = results[i * 4 + 3] != 0;
+		if(!beginAvailable || !endAvailable) continue;
+
+		double ms = ((end - begin) & timestampMask) * timestampPeriod / 1000000.0;
+
+		ScopeAccumulator& accumulator = accumulators[scopes[i]];
+		accumulator.minMs = accumulator.count == 0 ? ms : std::min(accumulator.minMs, ms);
+		accumulator.maxMs = std::max(accumulator.maxMs, ms);
+		accumulator.totalMs += ms;
+		accumulator.count++;
+	}
+}
+
+uint32_t GpuProfiler::getFirstQuery(uint32_t frameIndex)
+{
+	return frameIndex * maxScopesPerFrame * 2;
+}
+
+GpuProfiler::~GpuProfiler()
+{
+}
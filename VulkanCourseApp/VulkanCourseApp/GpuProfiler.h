@@ -0,0 +1,79 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <algorithm>
+
+#include "HostAllocator.h"
+
+//Min/avg/max GPU time of a named scope, in milliseconds
+struct GpuScopeStats {
+	std::string name;
+	uint32_t count;
+	double minMs;
+	double avgMs;
+	double maxMs;
+};
+
+//Timestamp queries around named scopes of command buffers
+//One range of queries per frame in flight: a range is read back only when its frame comes around again,
+//so results are always ready and reading them never stalls
+class GpuProfiler
+{
+public:
+	static const uint32_t INVALID_SCOPE = ~0u;
+
+	GpuProfiler();
+
+	//Disabled (scopes do nothing) if the queue has no timestamps or host query reset is not enabled
+	void create(VkPhysicalDevice physicalDevice, VkDevice newDevice, uint32_t queueFamilyIndex,
+		uint32_t newFrameCount, bool hostQueryReset, uint32_t newMaxScopesPerFrame = 64);
+	void destroy();
+
+	//Call once the GPU finished the last use of this frame: collects its results and reuses its queries
+	//Scopes recorded until the next beginFrame (including one-off uploads) go to this frame's range
+	void beginFrame(uint32_t frameIndex);
+
+	uint32_t beginScope(VkCommandBuffer commandBuffer, const std::string& name);
+	void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+	std::vector<GpuScopeStats> getStats();
+	void resetStats();
+
+	bool isEnabled();
+
+	~GpuProfiler();
+
+private:
+	VkDevice device;
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	bool enabled = false;
+
+	uint32_t frameCount = 0;
+	uint32_t maxScopesPerFrame = 0;
+	uint32_t currentFrame = 0;
+
+	double timestampPeriod = 1.0;			//Nanoseconds per tick
+	uint64_t timestampMask = ~0ull;			//Only timestampValidBits are meaningful
+
+	std::vector<std::vector<std::string>> frameScopes;		//Per frame: scope i uses queries 2i (begin) and 2i+1 (end)
+
+	struct ScopeAccumulator {
+		uint32_t count = 0;
+		double minMs = 0.0;
+		double maxMs = 0.0;
+		double totalMs = 0.0;
+	};
+	std::map<std::string, ScopeAccumulator> accumulators;
+
+	std::mutex profilerMutex;				//Scopes may be opened from upload code on other threads
+
+	void collectResults(uint32_t frameIndex);
+	uint32_t getFirstQuery(uint32_t frameIndex);
+};
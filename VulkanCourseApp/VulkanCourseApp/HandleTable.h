@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//Reference to an object of a HandleTable<T>: slot index + generation of the slot when the handle was made
+//Removing the object bumps the slot generation, so old handles stop resolving instead of aliasing its next user
+//Generation 0 is never used: a default constructed handle is always invalid
+template<typename T>
+struct Handle {
+	uint32_t index = 0;
+	uint32_t generation = 0;
+
+	bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+//Objects packed densely (iteration touches live objects only, in one array), addressed through stable handles
+//Insert, remove and lookup are O(1): slots map handles to dense positions, removal moves the last object
+//into the hole (so dense order is not stable, handles are)
+template<typename T>
+class HandleTable
+{
+public:
+	Handle<T> insert(const T& object)
+	{
+		//Reuse a freed slot (its generation was already bumped on removal), else add one
+		uint32_t slotIndex;
+		if(!freeSlots.empty())
+		{
+			slotIndex = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			slotIndex = static_cast<uint32_t>(slots.size());
+			Slot slot;
+			slot.generation = 1;
+			slots.push_back(slot);
+		}
+
+		slots[slotIndex].denseIndex = static_cast<uint32_t>(objects.size());
+		objects.push_back(object);
+		denseToSlot.push_back(slotIndex);
+
+		Handle<T> handle;
+		handle.index = slotIndex;
+		handle.generation = slots[slotIndex].generation;
+		return handle;
+	}
+
+	//False if the handle is stale (already removed) or was never valid
+	bool remove(Handle<T> handle)
+	{
+		if(!contains(handle)) return false;
+
+		//Last object fills the hole, its slot follows it
+		uint32_t denseIndex = slots[handle.index].denseIndex;
+		uint32_t lastIndex = static_cast<uint32_t>(objects.size() - 1);
+		if(denseIndex != lastIndex)
+		{
+			objects[denseIndex] = objects[lastIndex];
+			denseToSlot[denseIndex] = denseToSlot[lastIndex];
+			slots[denseToSlot[denseIndex]].denseIndex = denseIndex;
+		}
+		objects.pop_back();
+		denseToSlot.pop_back();
+
+		//Invalidate every handle to the slot (skip 0 on wrap around)
+		Slot& slot = slots[handle.index];
+		slot.denseIndex = INVALID_INDEX;
+		slot.generation = slot.generation + 1 == 0 ? 1 : slot.generation + 1;
+		freeSlots.push_back(handle.index);
+		return true;
+	}
+
+	bool contains(Handle<T> handle) const
+	{
+		return handle.index < slots.size() && handle.generation != 0 && slots[handle.index].generation == handle.generation
+			&& slots[handle.index].denseIndex != INVALID_INDEX;
+	}
+
+	//Null if the handle is stale, the pointer is only valid until the next insert/remove
+	T* get(Handle<T> handle)
+	{
+		if(!contains(handle)) return nullptr;
+		return &objects[slots[handle.index].denseIndex];
+	}
+
+	//Dense access, for iterating over every live object (0..size-1)
+	size_t size() const { return objects.size(); }
+	bool empty() const { return objects.empty(); }
+	T& at(size_t denseIndex) { return objects[denseIndex]; }
+	Handle<T> getHandle(size_t denseIndex) const
+	{
+		Handle<T> handle;
+		handle.index = denseToSlot[denseIndex];
+		handle.generation = slots[handle.index].generation;
+		return handle;
+	}
+
+	//Slots ever used (highest handle index + 1), for arrays indexed by handle index
+	size_t capacity() const { return slots.size(); }
+
+	typename std::vector<T>::iterator begin() { return objects.begin(); }
+	typename std::vector<T>::iterator end() { return objects.end(); }
+
+	//Removes everything, handles given out so far all become stale
+	void clear()
+	{
+		while(!objects.empty())
+		{
+			remove(getHandle(objects.size() - 1));
+		}
+	}
+
+private:
+	static const uint32_t INVALID_INDEX = ~0u;
+
+	struct Slot {
+		uint32_t denseIndex = INVALID_INDEX;
+		uint32_t generation = 0;
+	};
+
+	std::vector<T> objects;
+	std::vector<uint32_t> denseToSlot;		//Parallel to objects: the slot pointing at each one
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;
+};
@@ -0,0 +1,293 @@
+#include "HostAllocator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+std::mutex HostAllocator::poolMutex;
+std::vector<void*> HostAllocator::freeBlocks[HostAllocator::SIZE_CLASS_COUNT];
+std::vector<void*> HostAllocator::poolChunks;
+std::atomic<uint64_t> HostAllocator::pooledBytes(0);
+HostAllocator::ScopeCounters HostAllocator::scopeCounters[HostAllocator::SCOPE_COUNT];
+
+VkAllocationCallbacks HostAllocator::callbacks = {
+	nullptr,
+	&HostAllocator::allocate,
+	&HostAllocator::reallocate,
+	&HostAllocator::free,
+	&HostAllocator::internalAllocationNotification,
+	&HostAllocator::internalFreeNotification
+};
+
+//Where an allocation came from, stored right before the pointer handed to the driver
+enum AllocationSource : uint8_t {
+	ALLOCATION_SOURCE_POOL,
+	ALLOCATION_SOURCE_ARENA,
+	ALLOCATION_SOURCE_SYSTEM
+};
+
+struct AllocationHeader {
+	uint64_t size;
+	uint32_t offset;			//From the start of the underlying block to the returned pointer
+	uint8_t source;
+	uint8_t scope;
+	uint8_t sizeClass;
+	uint8_t padding;
+};
+
+//Command scope allocations of one thread: bump pointer, rewound when the last live one is freed
+//Command scope memory is freed before the Vulkan call that allocated it returns, so on the same thread
+struct CommandArena {
+	std::unique_ptr<uint8_t[]> memory;
+	size_t position = 0;
+	uint32_t liveAllocations = 0;
+};
+
+static thread_local CommandArena commandArena;
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+	//Vulkan alignments are powers of two
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void* systemAllocate(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+	return _aligned_malloc(size, alignment);
+#else
+	void* memory = nullptr;
+	if(posix_memalign(&memory, std::max(alignment, sizeof(void*)), size) != 0) return nullptr;
+	return memory;
+#endif
+}
+
+static void systemFree(void* memory)
+{
+#ifdef _WIN32
+	_aligned_free(memory);
+#else
+	std::free(memory);
+#endif
+}
+
+const VkAllocationCallbacks* HostAllocator::getCallbacks()
+{
+	return &callbacks;
+}
+
+HostScopeStats HostAllocator::getStats(VkSystemAllocationScope scope)
+{
+	const ScopeCounters& counters = scopeCounters[scope];
+
+	HostScopeStats stats;
+	stats.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+	stats.liveAllocations = counters.liveAllocations.load(std::memory_order_relaxed);
+	stats.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+	stats.totalAllocations = counters.totalAllocations.load(std::memory_order_relaxed);
+	stats.internalBytes = static_cast<uint64_t>(std::max<int64_t>(0, counters.internalBytes.load(std::memory_order_relaxed)));
+	return stats;
+}
+
+const char* HostAllocator::getScopeName(VkSystemAllocationScope scope)
+{
+	switch(scope)
+	{
+	case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:	return "Command";
+	case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT:		return "Object";
+	case VK_SYSTEM_ALLOCATION_SCOPE_CACHE:		return "Cache";
+	case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE:		return "Device";
+	case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE:	return "Instance";
+	default:									return "Unknown";
+	}
+}
+
+uint64_t HostAllocator::getPooledBytes()
+{
+	return pooledBytes.load(std::memory_order_relaxed);
+}
+
+void* HostAllocator::allocate(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if(size == 0) return nullptr;
+
+	//The header goes right before the returned pointer, keep both aligned
+	alignment = std::max(alignment, alignof(AllocationHeader));
+	size_t headerOffset = alignUp(sizeof(AllocationHeader), alignment);
+
+	AllocationHeader header = {};
+	header.size = size;
+	header.scope = static_cast<uint8_t>(scope);
+	uint8_t* memory = nullptr;
+
+	if(scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND)
+	{
+		CommandArena& arena = commandArena;
+		if(!arena.memory)
+		{
+			arena.memory.reset(new uint8_t[ARENA_SIZE]);
+		}
+
+		//Align the address, not the position: the arena itself is only aligned for new[]
+		uintptr_t base = reinterpret_cast<uintptr_t>(arena.memory.get());
+		uintptr_t address = alignUp(base + arena.position + sizeof(AllocationHeader), alignment);
+		if(address + size <= base + ARENA_SIZE)
+		{
+			memory = reinterpret_cast<uint8_t*>(address);
+			arena.position = address + size - base;
+			arena.liveAllocations++;
+			header.source = ALLOCATION_SOURCE_ARENA;
+		}
+	}
+	else if(alignment <= MIN_CLASS_SIZE && headerOffset + size <= (MIN_CLASS_SIZE << (SIZE_CLASS_COUNT - 1)))
+	{
+		//Smallest class that holds header + data, blocks are aligned to their class size (at least MIN_CLASS_SIZE)
+		uint32_t sizeClass = 0;
+		while((MIN_CLASS_SIZE << sizeClass) < headerOffset + size)
+		{
+			sizeClass++;
+		}
+
+		uint8_t* block = static_cast<uint8_t*>(allocateFromPool(sizeClass));
+		if(block != nullptr)
+		{
+			memory = block + headerOffset;
+			header.source = ALLOCATION_SOURCE_POOL;
+			header.sizeClass = static_cast<uint8_t>(sizeClass);
+			header.offset = static_cast<uint32_t>(headerOffset);
+		}
+	}
+
+	if(memory == nullptr)
+	{
+		uint8_t* block = static_cast<uint8_t*>(systemAllocate(headerOffset + size, alignment));
+		if(block == nullptr) return nullptr;
+
+		memory = block + headerOffset;
+		header.source = ALLOCATION_SOURCE_SYSTEM;
+		header.offset = static_cast<uint32_t>(headerOffset);
+	}
+
+	*reinterpret_cast<AllocationHeader*>(memory - sizeof(AllocationHeader)) = header;
+	countAllocation(scope, size);
+	return memory;
+}
+
+void* HostAllocator::reallocate(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if(original == nullptr)
+	{
+		return allocate(userData, size, alignment, scope);
+	}
+	if(size == 0)
+	{
+		free(userData, original);
+		return nullptr;
+	}
+
+	//On failure the original must stay valid, so allocate before freeing
+	void* memory = allocate(userData, size, alignment, scope);
+	if(memory == nullptr) return nullptr;
+
+	const AllocationHeader* header = reinterpret_cast<const AllocationHeader*>(static_cast<uint8_t*>(original) - sizeof(AllocationHeader));
+	memcpy(memory, original, static_cast<size_t>(std::min<uint64_t>(header->size, size)));
+	free(userData, original);
+	return memory;
+}
+
+void HostAllocator::free(void* userData, void* memory)
+{
+	if(memory == nullptr) return;
+
+	uint8_t* bytes = static_cast<uint8_t*>(memory);
+	AllocationHeader header = *reinterpret_cast<const AllocationHeader*>(bytes - sizeof(AllocationHeader));
+	countFree(static_cast<VkSystemAllocationScope>(header.scope), static_cast<size_t>(header.size));
+
+	switch(header.source)
+	{
+	case ALLOCATION_SOURCE_POOL:
+		releaseToPool(bytes - header.offset, header.sizeClass);
+		break;
+	case ALLOCATION_SOURCE_ARENA:
+	{
+		//Nothing to give back one by one, the whole arena is reused once it is empty
+		CommandArena& arena = commandArena;
+		if(arena.liveAllocations > 0 && --arena.liveAllocations == 0)
+		{
+			arena.position = 0;
+		}
+		break;
+	}
+	case ALLOCATION_SOURCE_SYSTEM:
+		systemFree(bytes - header.offset);
+		break;
+	}
+}
+
+void HostAllocator::internalAllocationNotification(void* userData, size_t size, VkInternalAllocationType allocationType,
+	VkSystemAllocationScope scope)
+{
+	scopeCounters[scope].internalBytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+}
+
+void HostAllocator::internalFreeNotification(void* userData, size_t size, VkInternalAllocationType allocationType,
+	VkSystemAllocationScope scope)
+{
+	scopeCounters[scope].internalBytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+}
+
+void* HostAllocator::allocateFromPool(uint32_t sizeClass)
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+
+	std::vector<void*>& blocks = freeBlocks[sizeClass];
+	if(blocks.empty())
+	{
+		//Carve a new chunk into blocks of this class
+		uint8_t* chunk = static_cast<uint8_t*>(systemAllocate(POOL_CHUNK_SIZE, MIN_CLASS_SIZE));
+		if(chunk == nullptr) return nullptr;
+		poolChunks.push_back(chunk);
+		pooledBytes.fetch_add(POOL_CHUNK_SIZE, std::memory_order_relaxed);
+
+		size_t blockSize = MIN_CLASS_SIZE << sizeClass;
+		for(size_t offset = POOL_CHUNK_SIZE; offset >= blockSize; offset -= blockSize)
+		{
+			blocks.push_back(chunk + offset - blockSize);
+		}
+	}
+
+	void* block = blocks.back();
+	blocks.pop_back();
+	return block;
+}
+
+void HostAllocator::releaseToPool(void* block, uint32_t sizeClass)
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+	freeBlocks[sizeClass].push_back(block);
+}
+
+void HostAllocator::countAllocation(VkSystemAllocationScope scope, size_t size)
+{
+	ScopeCounters& counters = scopeCounters[scope];
+	uint64_t liveBytes = counters.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+	counters.liveAllocations.fetch_add(1, std::memory_order_relaxed);
+	counters.totalAllocations.fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+	while(liveBytes > peakBytes && !counters.peakBytes.compare_exchange_weak(peakBytes, liveBytes, std::memory_order_relaxed))
+	{
+	}
+}
+
+void HostAllocator::countFree(VkSystemAllocationScope scope, size_t size)
+{
+	ScopeCounters& counters = scopeCounters[scope];
+	counters.liveBytes.fetch_sub(size, std::memory_order_relaxed);
+	counters.liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+}
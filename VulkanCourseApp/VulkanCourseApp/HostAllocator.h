@@ -0,0 +1,71 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+//Live host memory the driver holds in one VkSystemAllocationScope
+struct HostScopeStats {
+	uint64_t liveBytes = 0;
+	uint64_t liveAllocations = 0;
+	uint64_t peakBytes = 0;
+	uint64_t totalAllocations = 0;			//Since start, live or not
+	uint64_t internalBytes = 0;				//Allocated by the driver itself, only reported to us through the notifications
+};
+
+//VkAllocationCallbacks passed to every vkCreate*/vkDestroy* (a destroy must get the same callbacks as its create)
+//Object/cache/device/instance scope: long lived, freed in any order, served from pooled size classes
+//Command scope: only lives during one Vulkan call, served from a per thread linear arena rewound once it is empty
+//Anything bigger than the largest class (or over aligned, or with the arena full) goes to the system allocator
+class HostAllocator
+{
+public:
+	static const VkAllocationCallbacks* getCallbacks();
+
+	static HostScopeStats getStats(VkSystemAllocationScope scope);
+	static const char* getScopeName(VkSystemAllocationScope scope);
+	//Memory held by the size class pools, free blocks included (never given back to the system)
+	static uint64_t getPooledBytes();
+
+	static const uint32_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+private:
+	static const uint32_t SIZE_CLASS_COUNT = 7;			//64 bytes to 4 KB, doubling
+	static const size_t MIN_CLASS_SIZE = 64;
+	static const size_t POOL_CHUNK_SIZE = 64 * 1024;
+	static const size_t ARENA_SIZE = 256 * 1024;
+
+	struct ScopeCounters {
+		std::atomic<uint64_t> liveBytes;
+		std::atomic<uint64_t> liveAllocations;
+		std::atomic<uint64_t> peakBytes;
+		std::atomic<uint64_t> totalAllocations;
+		std::atomic<int64_t> internalBytes;
+	};
+
+	static VKAPI_ATTR void* VKAPI_CALL allocate(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void* VKAPI_CALL reallocate(void* userData, void* original, size_t size, size_t alignment,
+		VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL free(void* userData, void* memory);
+	static VKAPI_ATTR void VKAPI_CALL internalAllocationNotification(void* userData, size_t size,
+		VkInternalAllocationType allocationType, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL internalFreeNotification(void* userData, size_t size,
+		VkInternalAllocationType allocationType, VkSystemAllocationScope scope);
+
+	static void* allocateFromPool(uint32_t sizeClass);
+	static void releaseToPool(void* block, uint32_t sizeClass);
+	static void countAllocation(VkSystemAllocationScope scope, size_t size);
+	static void countFree(VkSystemAllocationScope scope, size_t size);
+
+	static VkAllocationCallbacks callbacks;
+	static ScopeCounters scopeCounters[SCOPE_COUNT];
+
+	//Free blocks of every size class, carved from chunks that stay alive until exit
+	static std::mutex poolMutex;
+	static std::vector<void*> freeBlocks[SIZE_CLASS_COUNT];
+	static std::vector<void*> poolChunks;
+	static std::atomic<uint64_t> pooledBytes;
+};
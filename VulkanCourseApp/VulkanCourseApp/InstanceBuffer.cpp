@@ -0,0 +1,118 @@
+#include "InstanceBuffer.h"
+
+InstanceBuffer::InstanceBuffer()
+{
+}
+
+void InstanceBuffer::create(DeviceAllocator* newAllocator, VkDevice newDevice, uint32_t newCapacity, uint32_t frameCount)
+{
+	allocator = newAllocator;
+	device = newDevice;
+
+	instances.assign(newCapacity, InstanceData());
+	ranges.reset(newCapacity);
+	createFrameBuffers(frameCount);
+}
+
+void InstanceBuffer::destroy()
+{
+	destroyFrameBuffers();
+}
+
+void InstanceBuffer::setFrameCount(uint32_t frameCount)
+{
+	destroyFrameBuffers();
+	createFrameBuffers(frameCount);
+}
+
+uint32_t InstanceBuffer::allocateRange(uint32_t count)
+{
+	return ranges.allocate(count);
+}
+
+void InstanceBuffer::releaseRange(uint32_t offset, uint32_t count)
+{
+	//Slots may be reused right away: frames in flight read their own buffer, which only changes when they sync
+	ranges.release(offset, count);
+}
+
+void InstanceBuffer::write(uint32_t slot, const InstanceData& data)
+{
+	instances[slot] = data;
+
+	//Once per frame until it synced, however often the slot is written
+	for(uint32_t i = 0; i < frameBuffers.size(); i++)
+	{
+		if(!(pendingFrames[slot] & (1u << i)))
+		{
+			pendingFrames[slot] |= 1u << i;
+			frameBuffers[i].pendingSlots.push_back(slot);
+		}
+	}
+}
+
+const InstanceData& InstanceBuffer::read(uint32_t slot)
+{
+	return instances[slot];
+}
+
+void InstanceBuffer::sync(uint32_t frameIndex)
+{
+	FrameBuffer& frameBuffer = frameBuffers[frameIndex];
+	InstanceData* mappedInstances = static_cast<InstanceData*>(frameBuffer.bufferAllocation.mappedData);
+
+	for(uint32_t slot : frameBuffer.pendingSlots)
+	{
+		mappedInstances[slot] = instances[slot];
+		pendingFrames[slot] &= ~(1u << frameIndex);
+	}
+	frameBuffer.pendingSlots.clear();
+}
+
+VkBuffer InstanceBuffer::getBuffer(uint32_t frameIndex)
+{
+	return frameBuffers[frameIndex].buffer;
+}
+
+uint32_t InstanceBuffer::getCapacity()
+{
+	return ranges.getCapacity();
+}
+
+uint32_t InstanceBuffer::getUsed()
+{
+	return ranges.getUsed();
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+}
+
+void InstanceBuffer::createFrameBuffers(uint32_t frameCount)
+{
+	frameBuffers.resize(frameCount);
+	pendingFrames.assign(instances.size(), 0);
+
+	for(auto& frameBuffer : frameBuffers)
+	{
+		//HOST_COHERENT: synced slots are visible to the frame's next submit without flushing
+		createBuffer(*allocator, device, sizeof(InstanceData) * (VkDeviceSize)instances.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&frameBuffer.buffer, &frameBuffer.bufferAllocation, MEMORY_CATEGORY_UNIFORMS);
+
+		//New buffer: start from the whole CPU copy
+		memcpy(frameBuffer.bufferAllocation.mappedData, instances.data(), sizeof(InstanceData) * instances.size());
+		frameBuffer.pendingSlots.clear();
+	}
+}
+
+void InstanceBuffer::destroyFrameBuffers()
+{
+	for(auto& frameBuffer : frameBuffers)
+	{
+		if(frameBuffer.buffer == VK_NULL_HANDLE) continue;
+		destroyBuffer(*allocator, device, frameBuffer.buffer, &frameBuffer.bufferAllocation);
+		frameBuffer.buffer = VK_NULL_HANDLE;
+	}
+	frameBuffers.clear();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "Utilities.h"
+#include "GeometryPool.h"
+#include "Mesh.h"
+
+//What the vertex shader reads per instance (std430: the struct is padded to 16 bytes, 80 in total)
+struct InstanceData {
+	glm::mat4 model;
+	uint32_t textureIndex;				//Element of the bindless texture array
+	uint32_t meshIndex;					//Handle index of its mesh, GPU culling finds the mesh data with it
+	uint32_t padding[2];
+};
+
+//Where an instance's data is, for moving it when its mesh's range changes
+struct Instance {
+	MeshHandle mesh;
+	uint32_t slot;
+	TextureHandle texture;				//Referenced by its textureIndex, counted in the texture's instanceCount
+};
+
+//Instance data of every mesh: a CPU copy plus one host visible buffer per frame in flight
+//Each mesh owns a contiguous range of slots, so all its instances are drawn by one vkCmdDrawIndexed (firstInstance = range start)
+//write() is O(1): it updates the CPU copy and marks the slot for every frame; a frame copies its marked slots when it
+//starts, once its previous submit is done, so the GPU never reads a buffer that is being written
+class InstanceBuffer
+{
+public:
+	InstanceBuffer();
+
+	void create(DeviceAllocator* newAllocator, VkDevice newDevice, uint32_t newCapacity, uint32_t frameCount);
+	void destroy();
+	//Frames in flight changed: buffers are recreated from the CPU copy (the GPU must be idle)
+	void setFrameCount(uint32_t frameCount);
+
+	//Contiguous range of slots for one mesh, FreeListAllocator::INVALID_OFFSET when full
+	uint32_t allocateRange(uint32_t count);
+	void releaseRange(uint32_t offset, uint32_t count);
+
+	void write(uint32_t slot, const InstanceData& data);
+	const InstanceData& read(uint32_t slot);
+
+	//Bring the frame's buffer up to date, only once the GPU finished the frame's last submit
+	void sync(uint32_t frameIndex);
+
+	VkBuffer getBuffer(uint32_t frameIndex);
+	uint32_t getCapacity();
+	uint32_t getUsed();
+
+	~InstanceBuffer();
+
+private:
+	DeviceAllocator* allocator;
+	VkDevice device;
+
+	std::vector<InstanceData> instances;			//CPU copy, the frame buffers follow it
+	FreeListAllocator ranges;
+
+	struct FrameBuffer {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		DeviceAllocation bufferAllocation;
+		std::vector<uint32_t> pendingSlots;			//Written since the frame last synced
+	};
+	std::vector<FrameBuffer> frameBuffers;
+	std::vector<uint32_t> pendingFrames;			//Per slot, bit per frame: already in that frame's pending list
+
+	void createFrameBuffers(uint32_t frameCount);
+	void destroyFrameBuffers();
+};
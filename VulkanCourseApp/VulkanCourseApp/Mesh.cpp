@@ -4,138 +4,112 @@ Mesh::Mesh()
 {
 }
 
-Mesh::Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice,
-        VkQueue transferQueue, VkCommandPool transferCommandPool,
+Mesh::Mesh(GeometryPool* newGeometryPool, UploadManager* uploadManager,
         std::vector<Vertex>* vertices, std::vector<uint32_t>* indices,
-        int newTexId)
+        TextureHandle newTexture)
 {
-    indexCount = indices->size();
-    vertexCount = vertices->size();
-    physicalDevice = newPhysicalDevice;
-    device = newDevice;
-    createVertexBuffer(transferQueue, transferCommandPool, vertices);
-    createIndexBuffer(transferQueue, transferCommandPool, indices);
-
-    model.model = glm::mat4(1.0f);
-    texId = newTexId;
+    geometryPool = newGeometryPool;
+    geometryRange = geometryPool->upload(*uploadManager, *vertices, *indices);
+
+    texture = newTexture;
+
+    //Box of the vertices, then the sphere around its centre (not the tightest, but never too small)
+    if(!vertices->empty())
+    {
+        glm::vec3 aabbMin = (*vertices)[0].pos;
+        glm::vec3 aabbMax = (*vertices)[0].pos;
+        for(const Vertex& vertex : *vertices)
+        {
+            aabbMin = glm::min(aabbMin, vertex.pos);
+            aabbMax = glm::max(aabbMax, vertex.pos);
+        }
+
+        glm::vec3 centre = (aabbMin + aabbMax) * 0.5f;
+        float radius = 0.0f;
+        for(const Vertex& vertex : *vertices)
+        {
+            radius = std::max(radius, glm::length(vertex.pos - centre));
+        }
+        bounds = glm::vec4(centre, radius);
+    }
 }
 
-void Mesh::setModel(glm::mat4 newModel)
+TextureHandle Mesh::getTexture()
 {
-    model.model = newModel;
+    return texture;
 }
 
-Model Mesh::getModel()
+glm::vec4 Mesh::getBounds()
 {
-    return model;
+    return bounds;
 }
 
-Model* Mesh::getModelPointer()
+void Mesh::setResident(bool newResident)
 {
-    return &model;
+    resident = newResident;
 }
 
-int Mesh::getTexId()
+bool Mesh::isResident()
 {
-    return texId;
+    return resident;
 }
 
-int Mesh::getVertexCount()
+void Mesh::setInstanceRange(uint32_t newInstanceOffset, uint32_t newInstanceCapacity)
 {
-    return vertexCount;
+    instanceOffset = newInstanceOffset;
+    instanceCapacity = newInstanceCapacity;
 }
 
-VkBuffer Mesh::getVertexBuffer()
+uint32_t Mesh::getInstanceOffset()
 {
-    return vertexBuffer;
+    return instanceOffset;
 }
 
-int Mesh::getIndexCount()
+uint32_t Mesh::getInstanceCapacity()
 {
-    return indexCount;
+    return instanceCapacity;
 }
 
-VkBuffer Mesh::getIndexBuffer()
+uint32_t Mesh::getInstanceCount()
 {
-    return indexBuffer;
+    return static_cast<uint32_t>(instances.size());
 }
 
-void Mesh::destroyBuffers()
+std::vector<InstanceHandle>& Mesh::getInstances()
 {
-    vkDestroyBuffer(device, vertexBuffer, /*Memory management TODO*/nullptr);
-    vkFreeMemory(device, vertexBufferMemory, /*Memory management TODO*/nullptr);
-
-    vkDestroyBuffer(device, indexBuffer, /*Memory management TODO*/nullptr);
-    vkFreeMemory(device, indexBufferMemory, /*Memory management TODO*/nullptr);
+    return instances;
 }
 
-Mesh::~Mesh()
+void Mesh::setDefaultInstance(InstanceHandle newDefaultInstance)
 {
+    defaultInstance = newDefaultInstance;
 }
 
-void Mesh::createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices)
+InstanceHandle Mesh::getDefaultInstance()
 {
-    //Get size of buffer needed for vertices
-    VkDeviceSize bufferSize = sizeof(Vertex) * vertices->size();
-
-    //Temporary buffer to stage vertex data before transferring to GPU
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-
-    //Create staging buffer and allocate memory to it
-    createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &stagingBuffer, &stagingBufferMemory);
-
-    //MAP MEMORY TO VERTEX BUFFER
-    void* data;                                                                       //1.Create pointer to a point in normal memory
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);       //2."Map" the vertex buffer memory to that point
-    memcpy(data, vertices->data(), (size_t)bufferSize);                           //3.Copy memory from vertices vector to the point
-    vkUnmapMemory(device,stagingBufferMemory);                                        //4.Unmap the vertex buffer memory
-
-    //Create buffer with TRANSFER_DST_BIT to mark as a recipient for transfer data (also VERTEX_BUFFER)
-    //Buffer memory is to be DEVICE_LOCAL_BIT meaning memory is on the GPU and not accessible by CPU
-    createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        &vertexBuffer, &vertexBufferMemory);
-
-    //Copy staging buffer to vertex buffer on GPU
-    copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, vertexBuffer, bufferSize);
-
-    //Clean up staging buffer parts
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    return defaultInstance;
 }
 
-void Mesh::createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices)
+int Mesh::getVertexCount()
 {
-    //Get size of buffer needed for indices
-    VkDeviceSize bufferSize = sizeof(uint32_t)* indices->size();
-
-    //Temporary buffer to stage index data before transferring to GPU
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    
-    //Create staging buffer and allocate memory to it
-    createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        &stagingBuffer, &stagingBufferMemory);
+    return geometryRange.vertexCount;
+}
 
-    //MAP MEMORY TO VERTEX BUFFER
-    void* data;                                                                       
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);      
-    memcpy(data, indices->data(), (size_t)bufferSize);                           
-    vkUnmapMemory(device,stagingBufferMemory);                                        
+int Mesh::getIndexCount()
+{
+    return geometryRange.indexCount;
+}
 
-    //Create buffer for index data on GPU access only area
-    createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        &indexBuffer, &indexBufferMemory);
+GeometryRange Mesh::getGeometryRange()
+{
+    return geometryRange;
+}
 
-    //Copy staging buffer to index buffer on GPU
-    copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, indexBuffer, bufferSize);
+void Mesh::freeGeometry()
+{
+    geometryPool->free(geometryRange);
+}
 
-    //Clean up staging buffer parts
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-}               
\ No newline at end of file
+Mesh::~Mesh()
+{
+}
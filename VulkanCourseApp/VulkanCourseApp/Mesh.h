@@ -4,54 +4,64 @@
 #include <GLFW/glfw3.h>
 
 #include <vector>
+#include <algorithm>
 
 #include "Utilities.h"
+#include "GeometryPool.h"
 
-struct Model{
-    glm::mat4 model;
-};
+//One drawn copy of a mesh, its data lives in the instance buffer (InstanceBuffer.h)
+struct Instance;
+typedef Handle<Instance> InstanceHandle;
 
 class Mesh
 {
 public:
     Mesh();
-    Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice,
-        VkQueue transferQueue, VkCommandPool transferCommandPool,
+    Mesh(GeometryPool* newGeometryPool, UploadManager* uploadManager,
         std::vector<Vertex>* vertices, std::vector<uint32_t>* indices,
-        int newTexId);
+        TextureHandle newTexture);
+
+    TextureHandle getTexture();
+    //Bounding sphere in model space (xyz = centre, w = radius), what frustum culling tests
+    glm::vec4 getBounds();
 
-    void setModel(glm::mat4 newModel);
-    Model getModel();
-    Model* getModelPointer();
+    //Instances live in a contiguous range of the instance buffer, all of them drawn by one instanced draw
+    void setInstanceRange(uint32_t newInstanceOffset, uint32_t newInstanceCapacity);
+    uint32_t getInstanceOffset();
+    uint32_t getInstanceCapacity();
+    uint32_t getInstanceCount();
+    //In slot order: instance i is in slot getInstanceOffset() + i
+    std::vector<InstanceHandle>& getInstances();
+    //Instance created with the mesh (its texture, identity transform), cleared if it is removed
+    void setDefaultInstance(InstanceHandle newDefaultInstance);
+    InstanceHandle getDefaultInstance();
 
-    int getTexId();
+    //Drawn only once its geometry upload completed
+    void setResident(bool newResident);
+    bool isResident();
     
     int getVertexCount();
-    VkBuffer getVertexBuffer();
-
     int getIndexCount();
-    VkBuffer getIndexBuffer();
+
+    //Vertices/indices of this mesh inside the shared geometry pool buffers
+    GeometryRange getGeometryRange();
     
-    void destroyBuffers();
+    void freeGeometry();
     
     ~Mesh();
 
 private:
-    Model model;
+    TextureHandle texture;
+    glm::vec4 bounds = glm::vec4(0.0f);
+    bool resident = true;
 
-    int texId;
+    uint32_t instanceOffset = 0;
+    uint32_t instanceCapacity = 0;
+    std::vector<InstanceHandle> instances;
+    InstanceHandle defaultInstance;
     
-    int vertexCount;
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
-
-    int indexCount;
-    VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
-    
-    VkPhysicalDevice physicalDevice;
-    VkDevice device;
-
-    void createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices);
-    void createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices);
+    GeometryPool* geometryPool;
+    GeometryRange geometryRange;
 };
+
+typedef Handle<Mesh> MeshHandle;
@@ -0,0 +1,74 @@
+#include "RingBuffer.h"
+
+RingBuffer::RingBuffer()
+{
+}
+
+void RingBuffer::create(DeviceAllocator* newAllocator, VkDevice newDevice, VkDeviceSize newCapacity, VkBufferUsageFlags usage)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	capacity = newCapacity;
+	head = 0;
+
+	//HOST_COHERENT: writes are visible to the GPU without flushing
+	createBuffer(*allocator, device, capacity, usage,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&buffer, &bufferAllocation, MEMORY_CATEGORY_UNIFORMS);
+
+	//Host visible allocations stay mapped for their whole lifetime
+	mappedData = static_cast<uint8_t*>(bufferAllocation.mappedData);
+}
+
+void RingBuffer::destroy()
+{
+	if(buffer == VK_NULL_HANDLE) return;
+
+	destroyBuffer(*allocator, device, buffer, &bufferAllocation);
+
+	buffer = VK_NULL_HANDLE;
+	mappedData = nullptr;
+}
+
+void RingBuffer::reset()
+{
+	head = 0;
+}
+
+RingAllocation RingBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	//Round head up to the alignment (alignments from device limits are powers of 2)
+	VkDeviceSize offset = alignment > 1 ? (head + alignment - 1) & ~(alignment - 1) : head;
+	if(offset + size > capacity)
+	{
+		throw std::runtime_error("Ring buffer out of space for this frame!");
+	}
+	head = offset + size;
+
+	RingAllocation allocation = {};
+	allocation.buffer = buffer;
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.data = mappedData + offset;
+
+	return allocation;
+}
+
+VkBuffer RingBuffer::getBuffer()
+{
+	return buffer;
+}
+
+VkDeviceSize RingBuffer::getCapacity()
+{
+	return capacity;
+}
+
+VkDeviceSize RingBuffer::getUsed()
+{
+	return head;
+}
+
+RingBuffer::~RingBuffer()
+{
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "Utilities.h"
+
+//Slice of a ring buffer, valid until the frame that allocated it comes around again
+struct RingAllocation {
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	void* data;					//Already mapped, write straight into it
+};
+
+//Persistently mapped, host coherent buffer that hands out aligned slices of frame local data
+//One per frame slot: frames cycle through the slots (the ring) and each slot is reset when its frame starts again,
+//so nothing has to be mapped/unmapped or freed one by one
+class RingBuffer
+{
+public:
+	RingBuffer();
+
+	void create(DeviceAllocator* newAllocator, VkDevice newDevice, VkDeviceSize newCapacity, VkBufferUsageFlags usage);
+	void destroy();
+
+	//Only call once the GPU finished with the last frame that used this slot
+	void reset();
+	RingAllocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+
+	VkBuffer getBuffer();
+	VkDeviceSize getCapacity();
+	VkDeviceSize getUsed();
+
+	~RingBuffer();
+
+private:
+	DeviceAllocator* allocator;
+	VkDevice device;
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	DeviceAllocation bufferAllocation;
+	uint8_t* mappedData = nullptr;
+
+	VkDeviceSize capacity = 0;
+	VkDeviceSize head = 0;				//First free byte
+};
@@ -1,3 +1,6 @@
-C:/VulkanSDK/1.3.296.0/Bin/glslangValidator.exe -V shader.vert
-C:/VulkanSDK/1.3.296.0/Bin/glslangValidator.exe -V shader.frag
+C:/VulkanSDK/1.3.296.0/Bin/glslangValidator.exe -V --target-env vulkan1.2 shader.vert -o vert.spv
+C:/VulkanSDK/1.3.296.0/Bin/glslangValidator.exe -V --target-env vulkan1.2 shader.frag -o frag.spv
+C:/VulkanSDK/1.3.296.0/Bin/glslangValidator.exe -V --target-env vulkan1.2 cull.comp -o cull.spv
+C:/VulkanSDK/1.3.296.0/Bin/glslangValidator.exe -V --target-env vulkan1.2 compact.comp -o compact.spv
+C:/VulkanSDK/1.3.296.0/Bin/glslangValidator.exe -V --target-env vulkan1.2 pyramid.comp -o pyramid.spv
 pause
\ No newline at end of file
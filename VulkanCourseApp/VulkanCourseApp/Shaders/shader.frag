@@ -1,12 +1,16 @@
 #version 450 //Use GLSL 4.5
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 fragCol;
 layout(location = 1) in vec2 fragTex;
+layout(location = 2) flat in uint fragTextureIndex;
 
-layout(set = 1, binding = 0) uniform sampler2D textureSampler;
+//Every texture, instances pick theirs by index (size is MAX_TEXTURES clamped to the device limits, set by the renderer)
+layout(constant_id = 0) const uint TEXTURE_ARRAY_SIZE = 1024;
+layout(set = 1, binding = 0) uniform sampler2D textures[TEXTURE_ARRAY_SIZE];
 
 layout(location = 0) out vec4 outColour;		//Final output colour (must also have location)
 
 void main() {
-	outColour = texture(textureSampler, fragTex);
+	outColour = texture(textures[nonuniformEXT(fragTextureIndex)], fragTex);
 }
\ No newline at end of file
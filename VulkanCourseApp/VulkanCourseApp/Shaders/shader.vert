@@ -9,21 +9,36 @@ layout(set = 0, binding = 0) uniform UboViewProjection {
 	mat4 view;
 } uboViewProjection;
 
-//NOT IN USE, LEFT FOR REFERENCE
-layout(set = 0, binding = 1) uniform UboModel {
+//Per instance data (InstanceData)
+struct Instance {
 	mat4 model;
-} uboModel;
+	uint textureIndex;
+	uint meshIndex;
+};
 
-layout(push_constant) uniform PushModel {
-	mat4 model;
-} pushModel;
+layout(std430, set = 0, binding = 1) readonly buffer InstanceBuffer {
+	Instance instances[];
+} instanceBuffer;
+
+//Instance slots that passed GPU culling, gl_InstanceIndex starts at the firstInstance of the mesh's range
+layout(std430, set = 0, binding = 2) readonly buffer VisibleInstances {
+	uint slots[];
+} visibleInstances;
+
+layout(push_constant) uniform InstanceSource {
+	uint visibleList;			//1: gl_InstanceIndex is a place in the visible list, 0: it is the instance slot
+} instanceSource;
 
 layout(location = 0) out vec3 fragCol;
 layout(location = 1) out vec2 fragTex;
+layout(location = 2) flat out uint fragTextureIndex;
 
 void main() {
-	gl_Position = uboViewProjection.projection * uboViewProjection.view * pushModel.model * vec4(pos, 1.0);
+	uint slot = instanceSource.visibleList != 0 ? visibleInstances.slots[gl_InstanceIndex] : gl_InstanceIndex;
+	Instance instance = instanceBuffer.instances[slot];
+	gl_Position = uboViewProjection.projection * uboViewProjection.view * instance.model * vec4(pos, 1.0);
 	
 	fragCol = col;
 	fragTex = tex;
+	fragTextureIndex = instance.textureIndex;
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "TimelineScheduler.h"
+
+#include "Tracer.h"
+
+TimelineScheduler::TimelineScheduler() : lastSubmittedValue(0), completedValue(0)
+{
+}
+
+void TimelineScheduler::create(VkDevice newDevice)
+{
+	device = newDevice;
+	lastSubmittedValue = 0;
+	completedValue = 0;
+
+	VkSemaphoreTypeCreateInfo typeCreateInfo = {};
+	typeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;		//Counter instead of signalled/unsignalled
+	typeCreateInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = &typeCreateInfo;
+
+	VkResult result = vkCreateSemaphore(device, &semaphoreCreateInfo, HostAllocator::getCallbacks(), &semaphore);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create timeline semaphore!");
+	}
+}
+
+void TimelineScheduler::destroy()
+{
+	vkDestroySemaphore(device, semaphore, HostAllocator::getCallbacks());
+	semaphore = VK_NULL_HANDLE;
+}
+
+uint64_t TimelineScheduler::nextSignalValue()
+{
+	return ++lastSubmittedValue;
+}
+
+uint64_t TimelineScheduler::getLastSubmittedValue()
+{
+	return lastSubmittedValue;
+}
+
+uint64_t TimelineScheduler::getCompletedValue()
+{
+	uint64_t value;
+	VkResult result = vkGetSemaphoreCounterValue(device, semaphore, &value);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to get timeline semaphore value!");
+	}
+
+	updateCompletedValue(value);
+	return value;
+}
+
+bool TimelineScheduler::isComplete(uint64_t value)
+{
+	//Only ask the driver when the cached value is not enough
+	return value <= completedValue || value <= getCompletedValue();
+}
+
+void TimelineScheduler::wait(uint64_t value)
+{
+	if(isComplete(value)) return;
+
+	//Only traced when the CPU actually blocks
+	TRACE_SCOPE("vkWaitSemaphores (timeline)");
+
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &semaphore;
+	waitInfo.pValues = &value;
+
+	VkResult result = vkWaitSemaphores(device, &waitInfo, std::numeric_limits<uint64_t>::max());
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to wait on timeline semaphore!");
+	}
+
+	updateCompletedValue(value);
+}
+
+void TimelineScheduler::waitIdle()
+{
+	wait(lastSubmittedValue);
+}
+
+VkSemaphore TimelineScheduler::getSemaphore()
+{
+	return semaphore;
+}
+
+void TimelineScheduler::updateCompletedValue(uint64_t value)
+{
+	uint64_t seen = completedValue;
+	while(seen < value && !completedValue.compare_exchange_weak(seen, value));
+}
+
+TimelineScheduler::~TimelineScheduler()
+{
+}
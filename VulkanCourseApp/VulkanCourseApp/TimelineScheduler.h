@@ -0,0 +1,49 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <atomic>
+#include <limits>
+
+#include "HostAllocator.h"
+
+//GPU progress as one monotonic counter (timeline semaphore): every submit signals the next value,
+//so "is work N done" is a comparison instead of a fence per submit
+//Anything that must outlive GPU work (frames, uploads, deletions) can remember the value it needs and wait only on reuse
+class TimelineScheduler
+{
+public:
+	TimelineScheduler();
+
+	void create(VkDevice newDevice);
+	void destroy();
+
+	//Value the next submit should signal (and the one to wait for before touching what it used)
+	uint64_t nextSignalValue();
+	uint64_t getLastSubmittedValue();
+
+	//Non blocking: last value the GPU reached
+	uint64_t getCompletedValue();
+	bool isComplete(uint64_t value);
+
+	//Block until the GPU reaches value (returns immediately if it already did)
+	void wait(uint64_t value);
+	//Block until everything submitted so far is done
+	void waitIdle();
+
+	VkSemaphore getSemaphore();
+
+	~TimelineScheduler();
+
+private:
+	VkDevice device;
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+
+	std::atomic<uint64_t> lastSubmittedValue;
+	std::atomic<uint64_t> completedValue;		//Cached, so isComplete rarely has to ask the driver
+
+	//Don't go backwards if another thread already saw a later value
+	void updateCompletedValue(uint64_t value);
+};
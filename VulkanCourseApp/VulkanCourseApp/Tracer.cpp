@@ -0,0 +1,125 @@
+#include "Tracer.h"
+
+#include <fstream>
+#include <stdexcept>
+
+std::mutex Tracer::registryMutex;
+std::vector<std::unique_ptr<ThreadTraceBuffer>> Tracer::threadBuffers;
+std::chrono::steady_clock::time_point Tracer::startTime = std::chrono::steady_clock::now();
+
+ThreadTraceBuffer::ThreadTraceBuffer(uint32_t newThreadId, size_t newCapacity)
+	: threadId(newThreadId), events(newCapacity), writeIndex(0), readIndex(0), droppedCount(0)
+{
+}
+
+void ThreadTraceBuffer::push(const TraceEvent& event)
+{
+	uint64_t write = writeIndex.load(std::memory_order_relaxed);
+	uint64_t read = readIndex.load(std::memory_order_acquire);
+	if(write - read >= events.size())
+	{
+		droppedCount.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	events[write % events.size()] = event;
+	//Publish the event after it is written
+	writeIndex.store(write + 1, std::memory_order_release);
+}
+
+void ThreadTraceBuffer::drain(std::vector<TraceEvent>& outEvents)
+{
+	uint64_t read = readIndex.load(std::memory_order_relaxed);
+	uint64_t write = writeIndex.load(std::memory_order_acquire);
+	for(uint64_t i = read; i < write; i++)
+	{
+		outEvents.push_back(events[i % events.size()]);
+	}
+	//Give the slots back to the producer
+	readIndex.store(write, std::memory_order_release);
+}
+
+uint32_t ThreadTraceBuffer::getThreadId()
+{
+	return threadId;
+}
+
+uint64_t ThreadTraceBuffer::getDroppedCount()
+{
+	return droppedCount.load(std::memory_order_relaxed);
+}
+
+uint64_t Tracer::now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void Tracer::record(const char* name, uint64_t start, uint64_t end)
+{
+	TraceEvent event = {};
+	event.name = name;
+	event.start = start;
+	event.duration = end - start;
+	getThreadBuffer()->push(event);
+}
+
+size_t Tracer::dump(const std::string& fileName)
+{
+	std::ofstream file(fileName);
+	if(!file.is_open())
+	{
+		throw std::runtime_error("Failed to open trace file!");
+	}
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+
+	//Chrome trace event format: "X" = complete event with duration, "M" = metadata (thread names)
+	file << "{\"traceEvents\":[\n";
+	size_t eventCount = 0;
+	bool first = true;
+	uint64_t droppedCount = 0;
+	std::vector<TraceEvent> events;
+	for(auto& buffer : threadBuffers)
+	{
+		uint32_t threadId = buffer->getThreadId();
+		file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadId
+			<< ",\"args\":{\"name\":\"" << (threadId == 0 ? "Main" : "Thread " + std::to_string(threadId)) << "\"}}";
+		first = false;
+
+		events.clear();
+		buffer->drain(events);
+		for(const auto& event : events)
+		{
+			file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadId
+				<< ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+		}
+		eventCount += events.size();
+		droppedCount += buffer->getDroppedCount();
+	}
+	file << "\n],\"otherData\":{\"droppedEvents\":" << droppedCount << "}}\n";
+
+	return eventCount;
+}
+
+bool Tracer::isEnabled()
+{
+#ifdef ENABLE_TRACING
+	return true;
+#else
+	return false;
+#endif
+}
+
+ThreadTraceBuffer* Tracer::getThreadBuffer()
+{
+	//Registration locks once per thread, every later event only touches the thread's own buffer
+	thread_local ThreadTraceBuffer* threadBuffer = nullptr;
+	if(threadBuffer == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		uint32_t threadId = static_cast<uint32_t>(threadBuffers.size());
+		threadBuffers.push_back(std::unique_ptr<ThreadTraceBuffer>(new ThreadTraceBuffer(threadId, EVENTS_PER_THREAD)));
+		threadBuffer = threadBuffers.back().get();
+	}
+	return threadBuffer;
+}
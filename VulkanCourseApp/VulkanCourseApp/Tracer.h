@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+//CPU scope tracing, dumped as Chrome trace JSON (open with chrome://tracing or ui.perfetto.dev)
+//Scopes compile to nothing unless ENABLE_TRACING is defined
+#ifdef ENABLE_TRACING
+	#define TRACE_CONCAT_INNER(a, b) a##b
+	#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+	//Name must be a string literal (only the pointer is stored)
+	#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+	#define TRACE_SCOPE(name)
+#endif
+
+//One complete event: name, start and duration in microseconds since the tracer started
+struct TraceEvent {
+	const char* name;
+	uint64_t start;
+	uint64_t duration;
+};
+
+//Events of one thread: single producer (the owning thread), single consumer (dump)
+//Writes never lock, if the consumer falls behind new events are dropped
+class ThreadTraceBuffer
+{
+public:
+	ThreadTraceBuffer(uint32_t newThreadId, size_t newCapacity);
+
+	void push(const TraceEvent& event);
+	//Move every published event out of the buffer
+	void drain(std::vector<TraceEvent>& outEvents);
+
+	uint32_t getThreadId();
+	uint64_t getDroppedCount();
+
+private:
+	uint32_t threadId;
+	std::vector<TraceEvent> events;
+	std::atomic<uint64_t> writeIndex;		//Only advanced by the owning thread
+	std::atomic<uint64_t> readIndex;		//Only advanced by drain
+	std::atomic<uint64_t> droppedCount;
+};
+
+class Tracer
+{
+public:
+	static uint64_t now();
+	static void record(const char* name, uint64_t start, uint64_t end);
+
+	//Write every event since the last dump to fileName, returns number of events written
+	static size_t dump(const std::string& fileName);
+
+	static bool isEnabled();
+
+private:
+	static const size_t EVENTS_PER_THREAD = 1 << 16;
+
+	static ThreadTraceBuffer* getThreadBuffer();
+
+	//Buffers outlive their threads so a dump after a worker stopped still sees its events
+	static std::mutex registryMutex;
+	static std::vector<std::unique_ptr<ThreadTraceBuffer>> threadBuffers;
+	static std::chrono::steady_clock::time_point startTime;
+};
+
+//Records the time between construction and destruction
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* newName) : name(newName), start(Tracer::now()) {}
+	~TraceScope() { Tracer::record(name, start, Tracer::now()); }
+
+private:
+	const char* name;
+	uint64_t start;
+};
@@ -0,0 +1,566 @@
+#include "UploadManager.h"
+
+#include "Tracer.h"
+
+UploadManager::UploadManager()
+{
+}
+
+void UploadManager::create(DeviceAllocator* newAllocator, VkDevice newDevice, VkQueue newTransferQueue, uint32_t newTransferFamily,
+	VkQueue newGraphicsQueue, uint32_t newGraphicsFamily, VkDeviceSize newStagingSize)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	transferQueue = newTransferQueue;
+	graphicsQueue = newGraphicsQueue;
+	transferFamily = newTransferFamily;
+	graphicsFamily = newGraphicsFamily;
+	ownershipTransfer = transferFamily != graphicsFamily;
+	stagingSize = newStagingSize;
+	writePosition = 0;
+	readPosition = 0;
+	submitCount = 0;
+
+	//Batch command buffers are recycled one by one once their batch completes
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = transferFamily;
+
+	VkResult result = vkCreateCommandPool(device, &poolInfo, HostAllocator::getCallbacks(), &commandPool);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create upload command pool!");
+	}
+
+	timeline.create(device);
+
+	if(ownershipTransfer)
+	{
+		//Acquire barriers have to be recorded for the family that receives the resources
+		poolInfo.queueFamilyIndex = graphicsFamily;
+		result = vkCreateCommandPool(device, &poolInfo, HostAllocator::getCallbacks(), &acquireCommandPool);
+		if(result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create upload acquire command pool!");
+		}
+
+		copyTimeline.create(device);
+	}
+
+	//Host visible for its whole lifetime, the allocator keeps it mapped
+	createBuffer(*allocator, device, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&stagingBuffer, &stagingAllocation, MEMORY_CATEGORY_STAGING);
+}
+
+void UploadManager::destroy()
+{
+	if(commandPool == VK_NULL_HANDLE) return;
+
+	waitIdle();
+
+	destroyBuffer(*allocator, device, stagingBuffer, &stagingAllocation);
+	stagingBuffer = VK_NULL_HANDLE;
+
+	//Frees every batch command buffer with it
+	vkDestroyCommandPool(device, commandPool, HostAllocator::getCallbacks());
+	commandPool = VK_NULL_HANDLE;
+	freeCommandBuffers.clear();
+
+	if(ownershipTransfer)
+	{
+		vkDestroyCommandPool(device, acquireCommandPool, HostAllocator::getCallbacks());
+		acquireCommandPool = VK_NULL_HANDLE;
+		freeAcquireCommandBuffers.clear();
+
+		copyTimeline.destroy();
+	}
+
+	timeline.destroy();
+}
+
+UploadTicket UploadManager::uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+	//Bigger than the ring: stage it in pieces, each piece may end up in a different batch
+	VkDeviceSize maxChunkSize = stagingSize / 2;
+	const uint8_t* srcData = static_cast<const uint8_t*>(data);
+
+	VkDeviceSize uploaded = 0;
+	while(uploaded < size)
+	{
+		VkDeviceSize chunkSize = std::min(size - uploaded, maxChunkSize);
+		VkDeviceSize stagingOffset = allocateStaging(chunkSize);
+		memcpy(static_cast<uint8_t*>(stagingAllocation.mappedData) + stagingOffset, srcData + uploaded, (size_t)chunkSize);
+
+		PendingBufferCopy copy = {};
+		copy.dstBuffer = dstBuffer;
+		copy.region.srcOffset = stagingOffset;
+		copy.region.dstOffset = dstOffset + uploaded;
+		copy.region.size = chunkSize;
+		pendingBufferCopies.push_back(copy);
+
+		uploaded += chunkSize;
+	}
+
+	return getCurrentTicket();
+}
+
+UploadTicket UploadManager::uploadImage(VkImage image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size)
+{
+	if(size > stagingSize)
+	{
+		throw std::runtime_error("Image upload larger than the staging ring!");
+	}
+
+	VkDeviceSize stagingOffset = allocateStaging(size);
+	memcpy(static_cast<uint8_t*>(stagingAllocation.mappedData) + stagingOffset, data, (size_t)size);
+
+	PendingImageCopy copy = {};
+	copy.image = image;
+	copy.region.bufferOffset = stagingOffset;					//Offset into data
+	copy.region.bufferRowLength = 0;							//Row length of data to calculate data spacing (0 = tightly packed)
+	copy.region.bufferImageHeight = 0;							//Image height to calculate data spacing
+	copy.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	copy.region.imageSubresource.mipLevel = 0;
+	copy.region.imageSubresource.baseArrayLayer = 0;
+	copy.region.imageSubresource.layerCount = 1;
+	copy.region.imageOffset = {0, 0, 0};
+	copy.region.imageExtent = {width, height, 1};
+	pendingImageCopies.push_back(copy);
+
+	return getCurrentTicket();
+}
+
+UploadTicket UploadManager::flush(GpuProfiler* profiler)
+{
+	if(pendingBufferCopies.empty() && pendingImageCopies.empty())
+	{
+		return getCopyTimeline().getLastSubmittedValue();
+	}
+
+	TRACE_SCOPE("UploadManager::flush");
+
+	//Queries of the frame's range are only collected for graphics queue work
+	if(ownershipTransfer)
+	{
+		profiler = nullptr;
+	}
+
+	VkCommandBuffer commandBuffer = acquireCommandBuffer(commandPool, freeCommandBuffers);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to start recording upload command buffer!");
+	}
+
+	uint32_t profilerScope = profiler ? profiler->beginScope(commandBuffer, "Upload batch") : GpuProfiler::INVALID_SCOPE;
+
+	//Every image of the batch goes to TRANSFER_DST in one barrier
+	std::vector<VkImageMemoryBarrier> imageBarriers(pendingImageCopies.size());
+	for(size_t i = 0; i < pendingImageCopies.size(); i++)
+	{
+		VkImageMemoryBarrier& barrier = imageBarriers[i];
+		barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = pendingImageCopies[i].image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	}
+	if(!imageBarriers.empty())
+	{
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	for(const auto& copy : pendingBufferCopies)
+	{
+		vkCmdCopyBuffer(commandBuffer, stagingBuffer, copy.dstBuffer, 1, &copy.region);
+	}
+	for(const auto& copy : pendingImageCopies)
+	{
+		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, copy.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy.region);
+	}
+
+	//Then make the copies visible to whatever the renderer reads them with (geometry, uniforms, sampled images)
+	for(auto& barrier : imageBarriers)
+	{
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+
+	VkCommandBuffer acquireBuffer = VK_NULL_HANDLE;
+	if(ownershipTransfer)
+	{
+		//Release every written range and image to the graphics family (the layout change happens with the transfer)
+		//Visibility is the acquire's job, so no destination access here
+		std::vector<VkBufferMemoryBarrier> bufferBarriers(pendingBufferCopies.size());
+		for(size_t i = 0; i < pendingBufferCopies.size(); i++)
+		{
+			VkBufferMemoryBarrier& barrier = bufferBarriers[i];
+			barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = 0;
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+			barrier.buffer = pendingBufferCopies[i].dstBuffer;
+			barrier.offset = pendingBufferCopies[i].region.dstOffset;
+			barrier.size = pendingBufferCopies[i].region.size;
+		}
+		for(auto& barrier : imageBarriers)
+		{
+			barrier.dstAccessMask = 0;
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+		}
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+		//The acquire repeats the same barriers on the graphics side, record it now while the copies are known
+		acquireBuffer = acquireCommandBuffer(acquireCommandPool, freeAcquireCommandBuffers);
+		recordAcquire(acquireBuffer, bufferBarriers, imageBarriers);
+	}
+	else
+	{
+		VkMemoryBarrier memoryBarrier = {};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+			VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			1, &memoryBarrier, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	if(profiler) profiler->endScope(commandBuffer, profilerScope);
+
+	result = vkEndCommandBuffer(commandBuffer);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to stop recording upload command buffer!");
+	}
+
+	//Signal the batch ticket, no fence and no wait: the ticket tells when the staging space is free again
+	UploadTicket ticket = getCopyTimeline().nextSignalValue();
+	VkSemaphore timelineSemaphore = getCopyTimeline().getSemaphore();
+
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.signalSemaphoreValueCount = 1;
+	timelineSubmitInfo.pSignalSemaphoreValues = &ticket;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineSubmitInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &timelineSemaphore;
+
+	result = vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit upload batch!");
+	}
+
+	InFlightBatch batch = {};
+	batch.ticket = ticket;
+	batch.stagingEnd = writePosition;
+	batch.commandBuffer = commandBuffer;
+	batch.acquireCommandBuffer = acquireBuffer;
+	inFlightBatches.push_back(batch);
+
+	pendingBufferCopies.clear();
+	pendingImageCopies.clear();
+	submitCount++;
+
+	return ticket;
+}
+
+void UploadManager::onComplete(UploadTicket ticket, std::function<void()> callback)
+{
+	PendingCallback pendingCallback;
+	pendingCallback.ticket = ticket;
+	pendingCallback.callback = callback;
+	pendingCallbacks.push_back(pendingCallback);
+}
+
+void UploadManager::update()
+{
+	retireCompletedBatches(false);
+	runCompletedCallbacks();
+}
+
+bool UploadManager::isComplete(UploadTicket ticket)
+{
+	return timeline.isComplete(ticket);
+}
+
+void UploadManager::wait(UploadTicket ticket)
+{
+	//Still pending: it has to be submitted before it can complete
+	if(ticket > getCopyTimeline().getLastSubmittedValue())
+	{
+		flush();
+	}
+
+	//Copies first, update then submits the acquire that completes the ticket
+	getCopyTimeline().wait(ticket);
+	update();
+	timeline.wait(ticket);
+	update();
+}
+
+void UploadManager::waitIdle()
+{
+	flush();
+	getCopyTimeline().waitIdle();
+	update();
+	timeline.waitIdle();
+	update();
+}
+
+VkDeviceSize UploadManager::getStagingUsed()
+{
+	return writePosition - readPosition;
+}
+
+uint32_t UploadManager::getSubmitCount()
+{
+	return submitCount;
+}
+
+bool UploadManager::usesTransferQueue()
+{
+	return ownershipTransfer;
+}
+
+UploadManager::~UploadManager()
+{
+}
+
+VkDeviceSize UploadManager::allocateStaging(VkDeviceSize size)
+{
+	//16 covers the copy offset alignment of every format uploaded here (texel size, multiple of 4)
+	const VkDeviceSize alignment = 16;
+	writePosition = (writePosition + alignment - 1) & ~(alignment - 1);
+
+	//Never split a copy across the end of the ring, skip to the start instead
+	VkDeviceSize ringOffset = writePosition % stagingSize;
+	if(ringOffset + size > stagingSize)
+	{
+		writePosition += stagingSize - ringOffset;
+	}
+
+	//Ring full: submit what is pending and wait for the oldest batches to give their space back
+	while(writePosition + size - readPosition > stagingSize)
+	{
+		if(inFlightBatches.empty())
+		{
+			flush();
+		}
+		retireCompletedBatches(true);
+	}
+
+	VkDeviceSize offset = writePosition % stagingSize;
+	writePosition += size;
+	return offset;
+}
+
+void UploadManager::retireCompletedBatches(bool wait)
+{
+	//Batches complete in submission order on one queue, stop at the first one still running
+	while(!inFlightBatches.empty())
+	{
+		InFlightBatch& batch = inFlightBatches.front();
+		if(wait)
+		{
+			getCopyTimeline().wait(batch.ticket);
+			wait = false;
+		}
+		else if(!getCopyTimeline().isComplete(batch.ticket))
+		{
+			break;
+		}
+
+		//Staging is free as soon as the copies are done, the acquire does not read it
+		readPosition = batch.stagingEnd;
+		freeCommandBuffers.push_back(batch.commandBuffer);
+		if(batch.acquireCommandBuffer != VK_NULL_HANDLE)
+		{
+			submitAcquire(batch);
+		}
+		inFlightBatches.pop_front();
+	}
+
+	while(!inFlightAcquires.empty() && timeline.isComplete(inFlightAcquires.front().ticket))
+	{
+		freeAcquireCommandBuffers.push_back(inFlightAcquires.front().commandBuffer);
+		inFlightAcquires.pop_front();
+	}
+
+	//Nothing used anymore: restart from wherever the writes are (drops the padding of a skipped ring end)
+	if(inFlightBatches.empty() && pendingBufferCopies.empty() && pendingImageCopies.empty())
+	{
+		readPosition = writePosition;
+	}
+}
+
+void UploadManager::runCompletedCallbacks()
+{
+	//Take the ready callbacks out first, a callback may queue new ones
+	std::vector<std::function<void()>> readyCallbacks;
+	for(size_t i = 0; i < pendingCallbacks.size();)
+	{
+		if(timeline.isComplete(pendingCallbacks[i].ticket))
+		{
+			readyCallbacks.push_back(pendingCallbacks[i].callback);
+			pendingCallbacks.erase(pendingCallbacks.begin() + i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	for(auto& callback : readyCallbacks)
+	{
+		callback();
+	}
+}
+
+void UploadManager::submitAcquire(const InFlightBatch& batch)
+{
+	//The copies are already done, so the wait never stalls the graphics queue; it is still needed so the
+	//release happens-before the acquire. It signals the upload timeline with the batch ticket (same order, same value)
+	VkSemaphore copySemaphore = copyTimeline.getSemaphore();
+	VkSemaphore timelineSemaphore = timeline.getSemaphore();
+	uint64_t waitValue = batch.ticket;
+	uint64_t signalValue = timeline.nextSignalValue();
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.waitSemaphoreValueCount = 1;
+	timelineSubmitInfo.pWaitSemaphoreValues = &waitValue;
+	timelineSubmitInfo.signalSemaphoreValueCount = 1;
+	timelineSubmitInfo.pSignalSemaphoreValues = &signalValue;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineSubmitInfo;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &copySemaphore;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.acquireCommandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &timelineSemaphore;
+
+	VkResult result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit upload acquire!");
+	}
+
+	InFlightAcquire acquire = {};
+	acquire.ticket = signalValue;
+	acquire.commandBuffer = batch.acquireCommandBuffer;
+	inFlightAcquires.push_back(acquire);
+}
+
+void UploadManager::recordAcquire(VkCommandBuffer commandBuffer, const std::vector<VkBufferMemoryBarrier>& bufferBarriers,
+	const std::vector<VkImageMemoryBarrier>& imageBarriers)
+{
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to start recording upload acquire command buffer!");
+	}
+
+	//Same ranges, families and layouts as the release, only the access masks move to the receiving side
+	std::vector<VkBufferMemoryBarrier> acquireBufferBarriers = bufferBarriers;
+	for(auto& barrier : acquireBufferBarriers)
+	{
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+			VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	}
+	std::vector<VkImageMemoryBarrier> acquireImageBarriers = imageBarriers;
+	for(auto& barrier : acquireImageBarriers)
+	{
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+
+	//Source stage matches the semaphore wait stage so the barrier chains after it
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr, static_cast<uint32_t>(acquireBufferBarriers.size()), acquireBufferBarriers.data(),
+		static_cast<uint32_t>(acquireImageBarriers.size()), acquireImageBarriers.data());
+
+	result = vkEndCommandBuffer(commandBuffer);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to stop recording upload acquire command buffer!");
+	}
+}
+
+VkCommandBuffer UploadManager::acquireCommandBuffer(VkCommandPool pool, std::vector<VkCommandBuffer>& freeList)
+{
+	if(!freeList.empty())
+	{
+		//Begin resets it (pool created with RESET_COMMAND_BUFFER)
+		VkCommandBuffer commandBuffer = freeList.back();
+		freeList.pop_back();
+		return commandBuffer;
+	}
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = pool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	VkResult result = vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate upload command buffer!");
+	}
+	return commandBuffer;
+}
+
+TimelineScheduler& UploadManager::getCopyTimeline()
+{
+	return ownershipTransfer ? copyTimeline : timeline;
+}
+
+UploadTicket UploadManager::getCurrentTicket()
+{
+	//The pending batch signals the value after the last submitted one
+	bool pending = !pendingBufferCopies.empty() || !pendingImageCopies.empty();
+	return getCopyTimeline().getLastSubmittedValue() + (pending ? 1 : 0);
+}
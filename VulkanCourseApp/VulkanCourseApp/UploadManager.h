@@ -0,0 +1,128 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+#include <deque>
+#include <functional>
+
+#include "Utilities.h"
+#include "TimelineScheduler.h"
+
+//Value of the upload timeline the batch holding an upload signals: done once isComplete(ticket)
+typedef uint64_t UploadTicket;
+
+//Batches staging copies instead of one submit + vkQueueWaitIdle per copy
+//Data goes into a persistent staging ring right away, the copies are recorded and submitted together on flush
+//and the ring space of a batch is reused once the upload timeline passes it
+//With a transfer only queue the copies run there next to rendering: each batch releases what it wrote to the graphics
+//family, and once its copies are done a matching acquire is submitted on the graphics queue, which completes the ticket
+class UploadManager
+{
+public:
+	UploadManager();
+
+	//Same queue for both: no ownership transfer, batches complete on the graphics queue like any other submit
+	void create(DeviceAllocator* newAllocator, VkDevice newDevice, VkQueue newTransferQueue, uint32_t newTransferFamily,
+		VkQueue newGraphicsQueue, uint32_t newGraphicsFamily, VkDeviceSize newStagingSize = STAGING_RING_SIZE);
+	//Waits for every batch still in flight
+	void destroy();
+
+	//Copy data to staging now, the GPU copy happens in the next flushed batch (flushes by itself if the ring is full)
+	UploadTicket uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+	//Whole RGBA8 image, left in SHADER_READ_ONLY_OPTIMAL layout
+	UploadTicket uploadImage(VkImage image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size);
+
+	//Submit pending copies as one command buffer, returns its ticket (no-op if nothing is pending)
+	//Profiler scopes must be read after a wait that covers the batch, so only pass it from the frame submit path
+	//(ignored on a transfer only queue: its timestamps are not part of the frame's query range)
+	UploadTicket flush(GpuProfiler* profiler = nullptr);
+
+	//Run callback once the ticket is complete (from update/wait, on the calling thread)
+	void onComplete(UploadTicket ticket, std::function<void()> callback);
+	//Non blocking: reclaim staging space of finished batches, submit their acquires and run their callbacks
+	//Call it before the frame submit, so acquires go to the graphics queue ahead of the draws
+	void update();
+
+	//Ticket everything queued so far completes with (the last submitted one if nothing is pending)
+	UploadTicket getCurrentTicket();
+
+	bool isComplete(UploadTicket ticket);
+	void wait(UploadTicket ticket);
+	//Flush and wait for everything
+	void waitIdle();
+
+	VkDeviceSize getStagingUsed();
+	uint32_t getSubmitCount();
+	bool usesTransferQueue();
+
+	~UploadManager();
+
+private:
+	struct PendingBufferCopy {
+		VkBuffer dstBuffer;
+		VkBufferCopy region;
+	};
+	struct PendingImageCopy {
+		VkImage image;
+		VkBufferImageCopy region;
+	};
+	struct InFlightBatch {
+		UploadTicket ticket;
+		uint64_t stagingEnd;				//Ring position freed once the batch completes
+		VkCommandBuffer commandBuffer;
+		VkCommandBuffer acquireCommandBuffer;		//Recorded with the batch, submitted once its copies are done
+	};
+	struct InFlightAcquire {
+		UploadTicket ticket;
+		VkCommandBuffer commandBuffer;
+	};
+	struct PendingCallback {
+		UploadTicket ticket;
+		std::function<void()> callback;
+	};
+
+	DeviceAllocator* allocator;
+	VkDevice device;
+	VkQueue transferQueue;
+	VkQueue graphicsQueue;
+	uint32_t transferFamily;
+	uint32_t graphicsFamily;
+	bool ownershipTransfer = false;				//Different families: exclusive resources must be released/acquired
+
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> freeCommandBuffers;
+	VkCommandPool acquireCommandPool = VK_NULL_HANDLE;		//Graphics family, only with ownership transfer
+	std::vector<VkCommandBuffer> freeAcquireCommandBuffers;
+
+	TimelineScheduler timeline;				//Own timeline: batches may complete out of order with the frames
+	TimelineScheduler copyTimeline;			//Copies done on the transfer queue, only with ownership transfer
+											//Every batch signals both once, in order, so they share ticket values
+
+	//Staging ring, positions grow forever and wrap with % stagingSize
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	DeviceAllocation stagingAllocation;
+	VkDeviceSize stagingSize = 0;
+	uint64_t writePosition = 0;				//Next free byte
+	uint64_t readPosition = 0;				//Oldest byte still used by a batch
+
+	std::vector<PendingBufferCopy> pendingBufferCopies;
+	std::vector<PendingImageCopy> pendingImageCopies;
+	std::deque<InFlightBatch> inFlightBatches;
+	std::deque<InFlightAcquire> inFlightAcquires;
+	std::vector<PendingCallback> pendingCallbacks;
+	uint32_t submitCount = 0;
+
+	//Reserve ring space, flushing and waiting for old batches if it is full, returns offset in the staging buffer
+	VkDeviceSize allocateStaging(VkDeviceSize size);
+	void retireCompletedBatches(bool wait);
+	void runCompletedCallbacks();
+	void submitAcquire(const InFlightBatch& batch);
+	VkCommandBuffer acquireCommandBuffer(VkCommandPool pool, std::vector<VkCommandBuffer>& freeList);
+	void recordAcquire(VkCommandBuffer commandBuffer, const std::vector<VkBufferMemoryBarrier>& bufferBarriers,
+		const std::vector<VkImageMemoryBarrier>& imageBarriers);
+	//Timeline the copies signal (the upload timeline itself when there is no ownership transfer)
+	TimelineScheduler& getCopyTimeline();
+};
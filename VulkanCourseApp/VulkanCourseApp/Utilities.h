@@ -7,8 +7,21 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
-const int MAX_FRAME_DRAWS = 2;
-const int MAX_OBJECTS = 2;
+#include "GpuProfiler.h"
+#include "DeviceAllocator.h"
+#include "HostAllocator.h"
+#include "HandleTable.h"
+
+const int DEFAULT_FRAMES_IN_FLIGHT = 2;
+const int MAX_FRAMES_IN_FLIGHT = 4;			//Upper bound for setFramesInFlight (descriptor pool is sized for it)
+const uint32_t MAX_INSTANCES = 64 * 1024;			//Instances of all meshes (5 MB of instance data per frame in flight)
+const uint32_t MAX_MESHES = 16 * 1024;				//Mesh handle indices GPU culling has room for
+const uint32_t MAX_TEXTURES = 1024;					//Size of the bindless texture array, if the device's sampler limits allow it
+const VkDeviceSize FRAME_RING_BUFFER_SIZE = 4 * 1024 * 1024;		//Bytes of frame local data (VP, draw commands, transient vertices) per frame
+const uint32_t GEOMETRY_POOL_VERTEX_CAPACITY = 1024 * 1024;		//Vertices shared by all meshes (32 MB)
+const uint32_t GEOMETRY_POOL_INDEX_CAPACITY = 4 * 1024 * 1024;	//Indices shared by all meshes (16 MB)
+const VkDeviceSize STAGING_RING_SIZE = 64 * 1024 * 1024;			//Upload staging space (biggest single texture upload)
+const uint32_t MIN_DEPTH_BITS = 24;				//Depth precision the scene needs (0.1-100 perspective range z-fights at 16 bits)
 
 const std::vector<const char*> deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
@@ -26,11 +39,12 @@ struct Vertex
 struct QueueFamilyIndices {
 	int graphicsFamily = -1;				//Location of Graphic Queue Family
 	int presentationFamily = -1;			//Location of Presentation Queue Family
+	int transferFamily = -1;				//Transfer only Queue Family (DMA engine), -1 = copies go through graphics
 	
-	//Check if Queue families are valid
-	bool isValid() 
+	//Check if Queue families are valid (presentation not needed when rendering offscreen)
+	bool isValid(bool needsPresentation = true) 
 	{
-		return graphicsFamily >= 0 && presentationFamily >= 0;
+		return graphicsFamily >= 0 && (presentationFamily >= 0 || !needsPresentation);
 	}
 };
 
@@ -46,6 +60,41 @@ struct SwapChainImage
 	VkImageView imageView;
 };
 
+//Texture image and the descriptor set sampling it, owned by the renderer
+struct Texture
+{
+	VkImage image;
+	DeviceAllocation imageAllocation;
+	VkImageView imageView;
+	uint32_t descriptorIndex;					//Element of the bindless texture array, what instances refer to
+	uint32_t instanceCount = 0;					//Instances sampling it, it can't be removed before they stop
+};
+
+typedef Handle<Texture> TextureHandle;
+
+//Planes of the view frustum from the rows of a view projection matrix (glm is column major: row i is m[0][i]..m[3][i])
+//Normalized, xyz pointing inside: a sphere is outside if dot(plane.xyz, centre) + plane.w < -radius for any plane
+static void extractFrustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6])
+{
+	glm::vec4 rows[4];
+	for(int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+	planes[0] = rows[3] + rows[0];		//Left
+	planes[1] = rows[3] - rows[0];		//Right
+	planes[2] = rows[3] + rows[1];		//Top/bottom (Y is flipped, both are tested anyway)
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[3] + rows[2];		//Near for a -1..1 depth range, slightly looser for 0..1 (never culls too much)
+	planes[5] = rows[3] - rows[2];		//Far
+
+	//Normalized, so distances compare with world space radii
+	for(int i = 0; i < 6; i++)
+	{
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
 static std::vector<char> readFile(const std::string &filename)
 {
 	//Open stream from given file
@@ -75,27 +124,46 @@ static std::vector<char> readFile(const std::string &filename)
 	return fileBuffer;
 }
 
-static uint32_t findMemoryTypeIndex(VkPhysicalDevice physicalDevice, uint32_t allowedTypes, VkMemoryPropertyFlags properties)
+static VkPipeline createComputePipeline(VkDevice device, VkPipelineLayout pipelineLayout, const std::string& fileName)
 {
-	//Get properties of physical device memory
-	VkPhysicalDeviceMemoryProperties memoryProperties = {};
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice,&memoryProperties);
+	auto shaderCode = readFile(fileName);
+
+	VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
+	shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shaderModuleCreateInfo.codeSize = shaderCode.size();
+	shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+
+	VkShaderModule shaderModule;
+	VkResult result = vkCreateShaderModule(device, &shaderModuleCreateInfo, HostAllocator::getCallbacks(), &shaderModule);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create a compute shader module!");
+	}
+
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCreateInfo.stage.module = shaderModule;
+	pipelineCreateInfo.stage.pName = "main";
+	pipelineCreateInfo.layout = pipelineLayout;
 
-	for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+	VkPipeline pipeline;
+	result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, HostAllocator::getCallbacks(), &pipeline);
+
+	//Module only needed while creating the pipeline
+	vkDestroyShaderModule(device, shaderModule, HostAllocator::getCallbacks());
+
+	if(result != VK_SUCCESS)
 	{
-		//Bit shifting masterclass in the if
-		if((allowedTypes & (1 << i))//Index of memory type must match corrisponding bit in allowedTypes
-			&& (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)//Desired property bit flags are part of memory type's property flags                       
-		{
-			//This memory type i valid, so return it
-			return i;
-		}
+		throw std::runtime_error("Failed to create a compute pipeline!");
 	}
+	return pipeline;
 }
 
-static void createBuffer(VkPhysicalDevice physicalDevice,
+static void createBuffer(DeviceAllocator& allocator,
 	VkDevice device, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage,
-	VkMemoryPropertyFlags bufferProperties, VkBuffer* buffer, VkDeviceMemory* bufferMemory)
+	VkMemoryPropertyFlags bufferProperties, VkBuffer* buffer, DeviceAllocation* bufferAllocation, DeviceMemoryCategory category)
 {
 	//CREATE VERTEX BUFFER
     //Information to create a buffer (doesn't include assigning memory)
@@ -105,32 +173,23 @@ static void createBuffer(VkPhysicalDevice physicalDevice,
     bufferInfo.usage = bufferUsage;									 //Multiple types of buffer possible
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;             //Similar to swapchain images, can share vertex buffer
 
-    VkResult result = vkCreateBuffer(device, &bufferInfo, /*Memory management TODO*/nullptr, buffer);
+    VkResult result = vkCreateBuffer(device, &bufferInfo, HostAllocator::getCallbacks(), buffer);
     if (result != VK_SUCCESS)
     {
         throw std::runtime_error("Failed to create a Vertex Buffer!");
     }
 
-    //GET BUFFER MEMORY REQUIREMENTS
-    VkMemoryRequirements memoryRequirements;
-    vkGetBufferMemoryRequirements(device, *buffer, &memoryRequirements);
-
     //ALLOCATE MEMORY BUFFER
-    VkMemoryAllocateInfo memoryAllocInfo = {};
-    memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocInfo.allocationSize = memoryRequirements.size;
-    memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(physicalDevice, memoryRequirements.memoryTypeBits, bufferProperties);       //Index of memory type on Physical Device thet has required bit flags
-                                        																										//VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT: CPU can interact with memory
-																																				//VK_MEMORY_PROPERTY_HOST_COHERENT_BIT: Allows placement of data straight into buffer after mapping (otherwise would have to specify manually)
-    //Allocate memory to VkDeviceMemory
-    result = vkAllocateMemory(device, &memoryAllocInfo,/*Memory management TODO*/nullptr, bufferMemory);
-    if (result != VK_SUCCESS)
-    {
-        throw std::runtime_error("Failed to allocate Vertex Buffer Memory!");
-    }
+    //Sub-allocated from a block of a memory type with the required bit flags, and bound at its offset
+    //VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT: CPU can interact with memory (already mapped, see bufferAllocation->mappedData)
+    //VK_MEMORY_PROPERTY_HOST_COHERENT_BIT: Allows placement of data straight into buffer after mapping (otherwise would have to specify manually)
+    *bufferAllocation = allocator.allocateBufferMemory(*buffer, bufferProperties, category);
+}
 
-    //Allocate memory to given vertex buffer
-    vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
+static void destroyBuffer(DeviceAllocator& allocator, VkDevice device, VkBuffer buffer, DeviceAllocation* bufferAllocation)
+{
+    vkDestroyBuffer(device, buffer, HostAllocator::getCallbacks());
+    allocator.free(*bufferAllocation);
 }
 
 static VkCommandBuffer beginCommandBuffer(VkDevice device, VkCommandPool commandPool)
@@ -179,30 +238,41 @@ static void endAndSubmitCommandBuffer(VkDevice device, VkCommandPool commandPool
 	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 }
 
-static void copyBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
-	VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize)
+static void copyBufferRegion(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
+	VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size,
+	GpuProfiler* profiler = nullptr)
 {
 	//Create Buffer
 	VkCommandBuffer transferCommandBuffer = beginCommandBuffer(device, transferCommandPool);
+	uint32_t profilerScope = profiler ? profiler->beginScope(transferCommandBuffer, "copyBuffer") : GpuProfiler::INVALID_SCOPE;
 	
 		//Region of data to copy from and to
 		VkBufferCopy bufferCopyRegion = {};
-		bufferCopyRegion.srcOffset = 0;
-		bufferCopyRegion.dstOffset = 0;
-		bufferCopyRegion.size = bufferSize;
+		bufferCopyRegion.srcOffset = srcOffset;
+		bufferCopyRegion.dstOffset = dstOffset;
+		bufferCopyRegion.size = size;
 
 		//Command to copy src buffer to dst buffer
 		vkCmdCopyBuffer(transferCommandBuffer, srcBuffer, dstBuffer, 1, &bufferCopyRegion);
 
+	if(profiler) profiler->endScope(transferCommandBuffer, profilerScope);
+
 	//End and submit command buffer
 	endAndSubmitCommandBuffer(device, transferCommandPool, transferQueue, transferCommandBuffer);
 }
 
+static void copyBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
+	VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize, GpuProfiler* profiler = nullptr)
+{
+	copyBufferRegion(device, transferQueue, transferCommandPool, srcBuffer, dstBuffer, 0, 0, bufferSize, profiler);
+}
+
 static void copyImageBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
-	VkBuffer srcBuffer, VkImage image, uint32_t width, uint32_t height)
+	VkBuffer srcBuffer, VkImage image, uint32_t width, uint32_t height, GpuProfiler* profiler = nullptr)
 {
 	//Create Buffer
 	VkCommandBuffer transferCommandBuffer = beginCommandBuffer(device, transferCommandPool);
+	uint32_t profilerScope = profiler ? profiler->beginScope(transferCommandBuffer, "copyImageBuffer") : GpuProfiler::INVALID_SCOPE;
 
 	VkBufferImageCopy imageRegion = {};
 	imageRegion.bufferOffset = 0;													//Offset into data
@@ -218,16 +288,67 @@ static void copyImageBuffer(VkDevice device, VkQueue transferQueue, VkCommandPoo
 	//Copy buffer to given image
 	vkCmdCopyBufferToImage(transferCommandBuffer, srcBuffer, image,
 		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageRegion);
+
+	if(profiler) profiler->endScope(transferCommandBuffer, profilerScope);
 	
 	//End and submit command buffer
 	endAndSubmitCommandBuffer(device, transferCommandPool, transferQueue, transferCommandBuffer);
 }
 
+static void copyImageToBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
+	VkImage image, VkBuffer dstBuffer, uint32_t width, uint32_t height, GpuProfiler* profiler = nullptr)
+{
+	//Create Buffer
+	VkCommandBuffer transferCommandBuffer = beginCommandBuffer(device, transferCommandPool);
+	uint32_t profilerScope = profiler ? profiler->beginScope(transferCommandBuffer, "copyImageToBuffer") : GpuProfiler::INVALID_SCOPE;
+
+	//Image is already in TRANSFER_SRC layout (render pass final layout), only make colour writes visible to the copy
+	VkImageMemoryBarrier imageMemoryBarrier = {};
+	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.image = image;
+	imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+	imageMemoryBarrier.subresourceRange.levelCount = 1;
+	imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+	imageMemoryBarrier.subresourceRange.layerCount = 1;
+	imageMemoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	vkCmdPipelineBarrier(transferCommandBuffer,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+	VkBufferImageCopy imageRegion = {};
+	imageRegion.bufferOffset = 0;
+	imageRegion.bufferRowLength = 0;												//0 = tightly packed
+	imageRegion.bufferImageHeight = 0;
+	imageRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageRegion.imageSubresource.mipLevel = 0;
+	imageRegion.imageSubresource.baseArrayLayer = 0;
+	imageRegion.imageSubresource.layerCount = 1;
+	imageRegion.imageOffset = {0,0,0};
+	imageRegion.imageExtent = {width,height,1};
+
+	//Copy given image to buffer
+	vkCmdCopyImageToBuffer(transferCommandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		dstBuffer, 1, &imageRegion);
+
+	if(profiler) profiler->endScope(transferCommandBuffer, profilerScope);
+
+	//End and submit command buffer
+	endAndSubmitCommandBuffer(device, transferCommandPool, transferQueue, transferCommandBuffer);
+}
+
 static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool commandPool,
-	VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout)
+	VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, GpuProfiler* profiler = nullptr)
 {
 	//Create Buffer
 	VkCommandBuffer commandBuffer = beginCommandBuffer(device, commandPool);
+	uint32_t profilerScope = profiler ? profiler->beginScope(commandBuffer, "transitionImageLayout") : GpuProfiler::INVALID_SCOPE;
 
 	VkImageMemoryBarrier imageMemoryBarrier = {};
 	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -272,6 +393,8 @@ static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool
 		0, nullptr,						//Buffer memory barrier count and data	
 		1, &imageMemoryBarrier			//Image memory barrier count and data
 	);
+
+	if(profiler) profiler->endScope(commandBuffer, profilerScope);
 	
 	//End and submit command buffer
 	endAndSubmitCommandBuffer(device, commandPool, queue, commandBuffer);
@@ -7,35 +7,105 @@ VulkanRenderer::VulkanRenderer()
 int VulkanRenderer::init(GLFWwindow* newWindow)
 {
 	window = newWindow;
+	headless = false;
 
+	//Resize events only raise a flag, the swapchain is rebuilt at the start of the next draw
+	glfwSetWindowUserPointer(window, this);
+	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+
+	return initRenderer();
+}
+
+int VulkanRenderer::initHeadless(uint32_t width, uint32_t height)
+{
+	window = nullptr;
+	headless = true;
+
+	//No surface to ask, the offscreen targets take the requested size
+	swapChainExtent = {width, height};
+
+	return initRenderer();
+}
+
+std::vector<uint8_t> VulkanRenderer::readFrame()
+{
+	if(!headless)
+	{
+		throw std::runtime_error("Frame readback is only available in headless mode!");
+	}
+
+	//Wait until the last submitted frame finished rendering
+	timeline.wait(frames[lastFrame].getSubmittedValue());
+
+	//Copy rendered image into host visible readback buffer
+	copyImageToBuffer(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool,
+		swapChainImages[lastImageIndex].image, readbackBuffer, swapChainExtent.width, swapChainExtent.height, &gpuProfiler);
+
+	VkDeviceSize frameSize = (VkDeviceSize)swapChainExtent.width * swapChainExtent.height * 4;
+	std::vector<uint8_t> pixels(frameSize);
+
+	//Readback buffer is host visible, so the allocator keeps it mapped
+	memcpy(pixels.data(), readbackBufferAllocation.mappedData, (size_t)frameSize);
+
+	return pixels;
+}
+
+VkExtent2D VulkanRenderer::getFrameExtent()
+{
+	return swapChainExtent;
+}
+
+int VulkanRenderer::initRenderer()
+{
 	try {
 		//The order counts!!
 		createInstance();
 		createDebugMessenger();
-		createSurface();
+		if(!headless)
+		{
+			createSurface();
+		}
 		getPhysicalDevice();
 		createLogicalDevice();
-		createSwapChain();
+		deviceAllocator.create(mainDevice.physicalDevice, mainDevice.logicalDevice, memoryBudgetSupported);
+		timeline.create(mainDevice.logicalDevice);
+		if(headless)
+		{
+			createOffscreenTargets();
+		}
+		else
+		{
+			createSwapChain();
+		}
 		createRenderPass();
+		createOcclusionRenderPasses();
 		createDescriptorSetLayout();
-		createPushConstantRange();
 		createGraphicsPipeline();
-		createDepthBufferImage();
+		if(hasDepthPyramid)
+		{
+			depthPyramid.create(&deviceAllocator, mainDevice.logicalDevice);
+		}
+		createRenderTargets();
 		createFrameBuffers();
 		createCommandPool();
-		createCommandBuffers();
+		uploadManager.create(&deviceAllocator, mainDevice.logicalDevice, transferQueue, transferQueueFamily,
+			graphicsQueue, getQueueFamiliesIndices(mainDevice.physicalDevice).graphicsFamily);
+		geometryPool.create(&deviceAllocator, mainDevice.logicalDevice, GEOMETRY_POOL_VERTEX_CAPACITY, GEOMETRY_POOL_INDEX_CAPACITY,
+			deviceAllocator.hasHostVisibleDeviceLocal());
+		instanceBuffer.create(&deviceAllocator, mainDevice.logicalDevice, MAX_INSTANCES, framesInFlight);
+		cullingPass.create(&deviceAllocator, mainDevice.logicalDevice, &instanceBuffer, framesInFlight);
+		recordThreadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), 8u));
+		recordWorkerPool.start(recordThreadCount);
+		createFrameContexts();
 		createTextureSampler();
 		//NOT IN USE UBOD
 		//allocateDynamicBufferTransferSpace();
-		createUniformBuffers();
 		createDescriptorPool();
 		createDescriptorSets();
-		createSynchronization();
+		createTextureDescriptorSet();
 
-		uboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 100.0f);
+		updateProjection();
 		uboViewProjection.view = glm::lookAt(glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-
-		uboViewProjection.projection[1][1] *= -1; //Vulkan by default invert y coordinate
 		
 		//Create a mesh
 		//Vertex data
@@ -59,18 +129,21 @@ int VulkanRenderer::init(GLFWwindow* newWindow)
 			2, 3, 0
 		};
 		
-		Mesh firstMesh = Mesh(mainDevice.physicalDevice, mainDevice.logicalDevice,
-			graphicsQueue, graphicsCommandPool, //Graphics queue are also transfer queue in vulkan
+		TRACE_SCOPE("Load meshes");
+		Mesh firstMesh = Mesh(&geometryPool, &uploadManager,
 			&meshVertices, &meshIndices,
 			createTexture("smile.png"));
 
-		Mesh secondMesh = Mesh(mainDevice.physicalDevice, mainDevice.logicalDevice,
-			graphicsQueue, graphicsCommandPool, //Graphics queue are also transfer queue in vulkan
+		Mesh secondMesh = Mesh(&geometryPool, &uploadManager,
 			&meshVertices2, &meshIndices,
 			createTexture("nosmile.png"));
 
-		meshList.push_back(firstMesh);
-		meshList.push_back(secondMesh);
+		insertMesh(firstMesh);
+		insertMesh(secondMesh);
+
+		//Assets are batched while loading, submit the rest and have everything resident before the first frame
+		uploadManager.flush(&gpuProfiler);
+		uploadManager.waitIdle();
 	}
 	catch (const std::runtime_error& e) {
 		printf("ERROR: %s", e.what());
@@ -81,73 +154,697 @@ int VulkanRenderer::init(GLFWwindow* newWindow)
 	return EXIT_SUCCESS;
 }
 
-void VulkanRenderer::updateModel(int modelId, glm::mat4 newModel)
+bool VulkanRenderer::updateModel(MeshHandle mesh, glm::mat4 newModel)
+{
+	Mesh* target = meshes.get(mesh);
+	if(target == nullptr || instances.get(target->getDefaultInstance()) == nullptr) return false;
+
+	updateInstance(target->getDefaultInstance(), newModel);
+	return true;
+}
+
+InstanceHandle VulkanRenderer::addInstance(MeshHandle mesh, glm::mat4 transform, TextureHandle texture)
+{
+	Mesh* target = meshes.get(mesh);
+	if(target == nullptr) return InstanceHandle();
+
+	if(target->getInstanceCount() == target->getInstanceCapacity())
+	{
+		growInstanceRange(*target);
+	}
+
+	//Appended after the mesh's other instances, the draw just gets one more
+	Instance instance;
+	instance.mesh = mesh;
+	instance.slot = target->getInstanceOffset() + target->getInstanceCount();
+	instance.texture = texture;
+
+	InstanceData data = {};
+	data.model = transform;
+	data.textureIndex = getTextureIndex(texture);
+	data.meshIndex = mesh.index;
+	instanceBuffer.write(instance.slot, data);
+	acquireTexture(texture);
+
+	InstanceHandle handle = instances.insert(instance);
+	target->getInstances().push_back(handle);
+	markCommandBuffersDirty();
+	return handle;
+}
+
+void VulkanRenderer::updateInstance(InstanceHandle instance, glm::mat4 transform)
+{
+	Instance* target = instances.get(instance);
+	if(target == nullptr) return;
+
+	InstanceData data = instanceBuffer.read(target->slot);
+	data.model = transform;
+	instanceBuffer.write(target->slot, data);
+}
+
+void VulkanRenderer::setInstanceTexture(InstanceHandle instance, TextureHandle texture)
+{
+	Instance* target = instances.get(instance);
+	if(target == nullptr) return;
+
+	InstanceData data = instanceBuffer.read(target->slot);
+	data.textureIndex = getTextureIndex(texture);
+	instanceBuffer.write(target->slot, data);
+
+	acquireTexture(texture);
+	releaseTexture(target->texture);
+	target->texture = texture;
+}
+
+void VulkanRenderer::removeInstance(InstanceHandle instance)
+{
+	Instance* target = instances.get(instance);
+	if(target == nullptr) return;
+
+	//The mesh's last instance fills the hole, so its range stays dense
+	Mesh& mesh = *meshes.get(target->mesh);
+	std::vector<InstanceHandle>& meshInstances = mesh.getInstances();
+	uint32_t slot = target->slot;
+	InstanceHandle lastHandle = meshInstances.back();
+	if(lastHandle != instance)
+	{
+		Instance* last = instances.get(lastHandle);
+		instanceBuffer.write(slot, instanceBuffer.read(last->slot));
+		last->slot = slot;
+		meshInstances[slot - mesh.getInstanceOffset()] = lastHandle;
+	}
+	meshInstances.pop_back();
+
+	//No other instance takes over (which one would depend on the removal order), updateModel reports it from now on
+	if(mesh.getDefaultInstance() == instance)
+	{
+		mesh.setDefaultInstance(InstanceHandle());
+	}
+
+	releaseTexture(target->texture);
+	instances.remove(instance);
+	markCommandBuffersDirty();
+}
+
+size_t VulkanRenderer::getInstanceCount()
+{
+	return instances.size();
+}
+
+UploadTicket VulkanRenderer::addMesh(std::vector<Vertex>* vertices, std::vector<uint32_t>* indices, TextureHandle texture,
+	MeshHandle* mesh)
+{
+	Mesh newMesh = Mesh(&geometryPool, &uploadManager, vertices, indices, texture);
+
+	//Drawing it before the copy (and the ownership transfer) completed would read garbage, recording skips it until then
+	newMesh.setResident(false);
+	MeshHandle handle = insertMesh(newMesh);
+	if(mesh != nullptr)
+	{
+		*mesh = handle;
+	}
+
+	UploadTicket ticket = uploadManager.getCurrentTicket();
+	uploadManager.onComplete(ticket, [this, handle, newMesh]() mutable {
+		Mesh* residentMesh = meshes.get(handle);
+		if(residentMesh == nullptr)
+		{
+			//Removed while uploading: never drawn, only the copy had to finish before its range is reused
+			newMesh.freeGeometry();
+			return;
+		}
+		residentMesh->setResident(true);
+		markCommandBuffersDirty();
+	});
+	return ticket;
+}
+
+void VulkanRenderer::removeMesh(MeshHandle mesh)
+{
+	Mesh* target = meshes.get(mesh);
+	if(target == nullptr) return;
+
+	//Out of the table now, so the next recording won't draw it; submitted frames may still do
+	//(their instance data too: frame buffers only change once their frame comes around again)
+	Mesh removedMesh = *target;
+	for(InstanceHandle instance : removedMesh.getInstances())
+	{
+		releaseTexture(instances.get(instance)->texture);
+		instances.remove(instance);
+	}
+	instanceBuffer.releaseRange(removedMesh.getInstanceOffset(), removedMesh.getInstanceCapacity());
+	meshes.remove(mesh);
+	markCommandBuffersDirty();
+
+	//Still uploading: the upload callback frees it
+	if(!removedMesh.isResident()) return;
+
+	deletionQueue.push(timeline.getLastSubmittedValue(), [removedMesh]() mutable {
+		removedMesh.freeGeometry();
+	});
+}
+
+TextureHandle VulkanRenderer::createTexture(std::string fileName)
+{
+	TRACE_SCOPE("createTexture");
+
+	Texture texture = {};
+
+	//Create texture image
+	texture.image = createTextureImage(fileName, &texture.imageAllocation);
+
+	//Create Image View
+	texture.imageView = createImageView(texture.image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	//Write it into the bindless texture array
+	texture.descriptorIndex = createTextureDescriptor(texture.imageView);
+
+	return textures.insert(texture);
+}
+
+void VulkanRenderer::removeTexture(TextureHandle texture)
+{
+	Texture* target = textures.get(texture);
+	if(target == nullptr) return;
+
+	//Its array element would be sampled after the image is destroyed, or show whatever texture reuses it
+	if(target->instanceCount > 0)
+	{
+		throw std::runtime_error("Texture is still used by instances!");
+	}
+
+	Texture removedTexture = *target;
+	textures.remove(texture);
+	markCommandBuffersDirty();
+
+	deletionQueue.push(timeline.getLastSubmittedValue(), [=]() mutable {
+		freeTextureDescriptors.push_back(removedTexture.descriptorIndex);		//Frames using the element are done
+		vkDestroyImageView(mainDevice.logicalDevice, removedTexture.imageView, HostAllocator::getCallbacks());
+		vkDestroyImage(mainDevice.logicalDevice, removedTexture.image, HostAllocator::getCallbacks());
+		deviceAllocator.free(removedTexture.imageAllocation);
+	});
+}
+
+size_t VulkanRenderer::getMeshCount()
+{
+	return meshes.size();
+}
+
+MeshHandle VulkanRenderer::getMeshHandle(size_t meshIndex)
+{
+	if(meshIndex >= meshes.size()) return MeshHandle();
+	return meshes.getHandle(meshIndex);
+}
+
+MeshHandle VulkanRenderer::insertMesh(const Mesh& mesh)
+{
+	MeshHandle handle = meshes.insert(mesh);
+	if(handle.index >= MAX_MESHES)
+	{
+		meshes.remove(handle);
+		throw std::runtime_error("Too many meshes for GPU culling!");
+	}
+	InstanceHandle defaultInstance = addInstance(handle, glm::mat4(1.0f), meshes.get(handle)->getTexture());
+	meshes.get(handle)->setDefaultInstance(defaultInstance);
+	return handle;
+}
+
+void VulkanRenderer::growInstanceRange(Mesh& mesh)
+{
+	uint32_t oldOffset = mesh.getInstanceOffset();
+	uint32_t newCapacity = std::max(1u, mesh.getInstanceCapacity() * 2);
+	uint32_t newOffset = instanceBuffer.allocateRange(newCapacity);
+	if(newOffset == FreeListAllocator::INVALID_OFFSET)
+	{
+		throw std::runtime_error("Instance buffer full!");
+	}
+
+	//Instances keep their handles, only their slots change
+	std::vector<InstanceHandle>& meshInstances = mesh.getInstances();
+	for(uint32_t i = 0; i < meshInstances.size(); i++)
+	{
+		instanceBuffer.write(newOffset + i, instanceBuffer.read(oldOffset + i));
+		instances.get(meshInstances[i])->slot = newOffset + i;
+	}
+
+	if(mesh.getInstanceCapacity() > 0)
+	{
+		instanceBuffer.releaseRange(oldOffset, mesh.getInstanceCapacity());
+	}
+	mesh.setInstanceRange(newOffset, newCapacity);
+}
+
+uint32_t VulkanRenderer::getTextureIndex(TextureHandle texture)
+{
+	Texture* target = textures.get(texture);
+	if(target == nullptr)
+	{
+		throw std::runtime_error("Instance uses a removed texture!");
+	}
+	return target->descriptorIndex;
+}
+
+void VulkanRenderer::acquireTexture(TextureHandle texture)
+{
+	textures.get(texture)->instanceCount++;
+}
+
+void VulkanRenderer::releaseTexture(TextureHandle texture)
+{
+	//Removal is refused while counted, so the texture is still there
+	textures.get(texture)->instanceCount--;
+}
+
+void VulkanRenderer::setCommandBufferCaching(bool enabled)
+{
+	cacheCommandBuffers = enabled;
+	markCommandBuffersDirty();
+}
+
+void VulkanRenderer::markCommandBuffersDirty()
+{
+	for(auto& frame : frames)
+	{
+		frame.markDirty();
+	}
+}
+
+void VulkanRenderer::setIndirectDrawing(bool enabled)
+{
+	indirectDrawing = enabled;
+	markCommandBuffersDirty();
+}
+
+bool VulkanRenderer::isIndirectDrawing()
+{
+	return indirectDrawing && indirectDrawSupported;
+}
+
+void VulkanRenderer::setGpuCulling(bool enabled)
+{
+	gpuCulling = enabled;
+	markCommandBuffersDirty();
+}
+
+bool VulkanRenderer::isGpuCulling()
+{
+	return gpuCulling && isIndirectDrawing() && drawIndirectCountSupported;
+}
+
+void VulkanRenderer::setCpuCulling(bool enabled)
+{
+	cpuCulling = enabled;
+	markCommandBuffersDirty();
+}
+
+bool VulkanRenderer::isCpuCulling()
+{
+	return cpuCulling && !isGpuCulling();
+}
+
+CullStats VulkanRenderer::getCullStats()
+{
+	if(!isCpuCulling()) return CullStats();
+	return frustumCuller.getStats();
+}
+
+void VulkanRenderer::setOcclusionCulling(bool enabled)
+{
+	//Only the primary buffer changes, it is recorded every frame
+	occlusionCulling = enabled;
+}
+
+bool VulkanRenderer::isOcclusionCulling()
+{
+	return occlusionCulling && hasDepthPyramid && isGpuCulling();
+}
+
+void VulkanRenderer::setFramesInFlight(uint32_t frameCount)
+{
+	frameCount = std::max(1u, std::min(frameCount, (uint32_t)MAX_FRAMES_IN_FLIGHT));
+
+	//Not initialized yet: frame contexts will be created with this depth
+	if(frames.empty())
+	{
+		framesInFlight = frameCount;
+		return;
+	}
+	if(frameCount == framesInFlight) return;
+
+	//Frame contexts (and offscreen targets) may still be in use, their semaphores by a pending present
+	waitFramesIdle();
+
+	destroyFrameContexts();
+	vkResetDescriptorPool(mainDevice.logicalDevice, descriptorPool, 0);		//Frees all frame descriptor sets
+	framesInFlight = frameCount;
+	instanceBuffer.setFrameCount(framesInFlight);
+	cullingPass.setFrameCount(framesInFlight);
+
+	//Headless renders into one target per frame in flight, framebuffers follow them
+	if(headless)
+	{
+		for(auto frameBuffer : swapChainFrameBuffers)
+		{
+			vkDestroyFramebuffer(mainDevice.logicalDevice, frameBuffer, HostAllocator::getCallbacks());
+		}
+		destroyOffscreenTargets();
+		createOffscreenTargets();
+		createFrameBuffers();
+	}
+
+	createFrameContexts();
+	createDescriptorSets();
+}
+
+uint32_t VulkanRenderer::getFramesInFlight()
+{
+	return framesInFlight;
+}
+
+void VulkanRenderer::setRecordThreadCount(uint32_t threadCount)
+{
+	//Secondary buffers may still be in flight
+	waitFramesIdle();
+
+	recordThreadCount = std::max(1u, threadCount);
+	recordWorkerPool.stop();
+	recordWorkerPool.start(recordThreadCount);
+
+	//New workers have new buffers, so every frame re-records
+	for(auto& frame : frames)
+	{
+		frame.destroyWorkers();
+		frame.createWorkers(recordThreadCount);
+	}
+}
+
+void VulkanRenderer::benchmarkRecording(uint32_t maxThreads, uint32_t objectCount, uint32_t iterations)
+{
+	//Fill scene with copies of the loaded meshes (they share geometry, removed again before returning)
+	size_t originalMeshCount = meshes.size();
+	std::vector<MeshHandle> copies;
+	for(size_t i = originalMeshCount; i < objectCount; i++)
+	{
+		Mesh copy = meshes.at(i % originalMeshCount);
+		copies.push_back(meshes.insert(copy));
+	}
+
+	uint32_t originalThreadCount = recordThreadCount;
+	double singleThreadTime = 0.0;
+
+	//Indirect drawing records one call on one worker whatever the thread count, only direct draws spread over the workers
+	bool originalIndirectDrawing = indirectDrawing;
+	indirectDrawing = false;
+	//Direct draws skip what the CPU culled, that needs a cull of the current scene
+	if(isCpuCulling())
+	{
+		cullOnHost();
+	}
+
+	std::cout << "Recording " << meshes.size() << " objects, " << iterations << " iterations" << std::endl;
+	for(uint32_t threadCount = 1; threadCount <= maxThreads; threadCount++)
+	{
+		setRecordThreadCount(threadCount);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for(uint32_t i = 0; i < iterations; i++)
+		{
+			recordDrawCommands(0);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double msPerRecord = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+		if(threadCount == 1)
+		{
+			singleThreadTime = msPerRecord;
+		}
+
+		std::cout << "  " << threadCount << " thread(s): " << msPerRecord << " ms/record, speedup x"
+			<< singleThreadTime / msPerRecord << std::endl;
+	}
+
+	for(MeshHandle copy : copies)
+	{
+		meshes.remove(copy);
+	}
+	setRecordThreadCount(originalThreadCount);
+	setIndirectDrawing(originalIndirectDrawing);		//Also drops the recordings made here
+}
+
+void VulkanRenderer::benchmarkUploads(uint32_t iterations)
+{
+	const VkDeviceSize uploadSizes[] = { 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+	const VkDeviceSize maxUploadSize = 16 * 1024 * 1024;
+	std::vector<uint8_t> data(static_cast<size_t>(maxUploadSize), 0x5a);
+
+	VkBuffer stagedBuffer;
+	DeviceAllocation stagedAllocation;
+	createBuffer(deviceAllocator, mainDevice.logicalDevice, maxUploadSize,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&stagedBuffer, &stagedAllocation, MEMORY_CATEGORY_OTHER);
+
+	//Without it the allocator would fall back to host memory, which is not what is being measured
+	bool directWrites = deviceAllocator.hasHostVisibleDeviceLocal();
+	VkBuffer directBuffer = VK_NULL_HANDLE;
+	DeviceAllocation directAllocation;
+	if(directWrites)
+	{
+		createBuffer(deviceAllocator, mainDevice.logicalDevice, maxUploadSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&directBuffer, &directAllocation, MEMORY_CATEGORY_OTHER);
+	}
+	else
+	{
+		std::cout << "No host visible device local memory (needs resizable BAR or unified memory), direct path skipped" << std::endl;
+	}
+
+	std::cout << "Uploads, " << iterations << " iterations per size"
+		<< (uploadManager.usesTransferQueue() ? " (staging on the transfer queue)" : "") << std::endl;
+	for(VkDeviceSize size : uploadSizes)
+	{
+		//Staged: into the ring, flushed and waited on, so the data is usable by the next frame
+		auto start = std::chrono::high_resolution_clock::now();
+		for(uint32_t i = 0; i < iterations; i++)
+		{
+			UploadTicket ticket = uploadManager.uploadBuffer(stagedBuffer, 0, data.data(), size);
+			uploadManager.wait(ticket);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double stagedMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+		double sizeMb = static_cast<double>(size) / (1024.0 * 1024.0);
+
+		std::cout << "  " << size / 1024 << " KB: staged " << stagedMs << " ms (" << sizeMb / (stagedMs / 1000.0) << " MB/s)";
+
+		//Direct: the write is all there is, coherent memory is visible to the next submit
+		if(directWrites)
+		{
+			start = std::chrono::high_resolution_clock::now();
+			for(uint32_t i = 0; i < iterations; i++)
+			{
+				memcpy(directAllocation.mappedData, data.data(), static_cast<size_t>(size));
+			}
+			end = std::chrono::high_resolution_clock::now();
+			double directMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+			std::cout << ", direct " << directMs << " ms (" << sizeMb / (directMs / 1000.0) << " MB/s)";
+		}
+		std::cout << std::endl;
+	}
+
+	destroyBuffer(deviceAllocator, mainDevice.logicalDevice, stagedBuffer, &stagedAllocation);
+	if(directWrites)
+	{
+		destroyBuffer(deviceAllocator, mainDevice.logicalDevice, directBuffer, &directAllocation);
+	}
+}
+
+void VulkanRenderer::setPresentPolicy(PresentPolicy policy, double targetFps)
+{
+	bool modeChanged = policy != framePacer.getPolicy();
+	framePacer.setPolicy(policy, targetFps);
+
+	//Present mode is a swapchain property
+	if(modeChanged && !headless && swapChain != VK_NULL_HANDLE)
+	{
+		recreateSwapChain();
+	}
+}
+
+void VulkanRenderer::waitForNextFrame()
 {
-	if(modelId >= meshList.size()) return;
+	//Block on the GPU before the frame starts (not after input was sampled), beginFrame then returns immediately
+	timeline.wait(frames[currentFrame].getSubmittedValue());
+	framePacer.waitForFrameStart();
+}
+
+FrameTiming VulkanRenderer::getLastFrameTiming()
+{
+	return framePacer.getLastFrameTiming();
+}
+
+FrameTimingStats VulkanRenderer::getFrameTimingStats()
+{
+	return framePacer.getStats();
+}
+
+std::vector<GpuScopeStats> VulkanRenderer::getGpuTimings()
+{
+	return gpuProfiler.getStats();
+}
+
+std::vector<DeviceHeapStats> VulkanRenderer::getMemoryStats()
+{
+	return deviceAllocator.getHeapStats();
+}
 
-	meshList[modelId].setModel(newModel);
+uint32_t VulkanRenderer::getDeviceMemoryCount()
+{
+	return deviceAllocator.getDeviceMemoryCount();
 }
 
 void VulkanRenderer::draw()
 {
+	TRACE_SCOPE("draw");
+
+	//Window resized since last frame: rebuild before acquiring (nothing to draw while minimized)
+	if(framebufferResized)
+	{
+		recreateSwapChain();
+		if(framebufferResized) return;
+	}
+
+	FrameContext& frame = frames[currentFrame];
+
 	//1. Get the next available image to draw and set something to signal when we are finished with image (semaphore)
 	//--GET NEXT IMAGE--
-	//Wait for given fence to signal (open) from last draw before continuing
-	vkWaitForFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
-	//Manually reset (close) fence
-	vkResetFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame]);
+	//Wait for the last submit of this frame context to finish, then recycle its command buffer and frame data
+	frame.beginFrame(timeline);
+	gpuProfiler.beginFrame(currentFrame);		//Same wait covers the frame's timestamp queries
+	uploadManager.update();
+	deviceAllocator.updateBudget();
+	deletionQueue.flush(timeline, false);
 	
 	//Get index of the next image to be drawn to, and signal semaphore when ready to be drawn to
 	uint32_t imageIndex;
-	vkAcquireNextImageKHR(mainDevice.logicalDevice, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	if(headless)
+	{
+		//One offscreen target per frame in flight, so it is free once the timeline passed its last submit
+		imageIndex = currentFrame;
+	}
+	else
+	{
+		TRACE_SCOPE("vkAcquireNextImageKHR");
+		VkResult result = vkAcquireNextImageKHR(mainDevice.logicalDevice, swapChain, std::numeric_limits<uint64_t>::max(), frame.getImageAvailable(), VK_NULL_HANDLE, &imageIndex);
+		//Out of date: can't present to this swapchain anymore, skip the frame (SUBOPTIMAL still presents, recreated after)
+		if(result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			recreateSwapChain();
+			return;
+		}
+		if(result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+		{
+			throw std::runtime_error("Failed to acquire swapchain image!");
+		}
+	}
 	
-	recordCommands(imageIndex);
-	updateUniformBuffers(imageIndex);
+	//Write frame data first, the secondary buffers bake its offsets
+	updateUniformBuffers(currentFrame);
+
+	//Re-record draws only when the scene structure changed, the frame data moved (or caching is disabled)
+	if(!cacheCommandBuffers || !frame.isRecordingValid())
+	{
+		recordDrawCommands(currentFrame);
+	}
+	//Primary buffer only begins the render pass on the acquired image and executes the draws, cheap to record every frame
+	recordCommands(currentFrame, imageIndex);
+
+	//Uploads queued since the last frame go first on the same queue, their barrier orders them before the draws
+	uploadManager.flush(&gpuProfiler);
 	
 	//2. Submit command buffer to queue for execution, making sure it waits for the image to be signalled as available before drawing
 	//and signal when it finished rendering
 	//--SUBMIT COMMAND BUFFER TO RENDER--
+	VkSemaphore imageAvailable = frame.getImageAvailable();
+	VkSemaphore renderFinished = frame.getRenderFinished();
+	VkCommandBuffer commandBuffer = frame.getCommandBuffer();
+
+	//Signal the next timeline value (for whoever waits on this frame) + binary semaphore for presentation
+	uint64_t signalValue = timeline.nextSignalValue();
+	std::array<VkSemaphore, 2> signalSemaphores = {timeline.getSemaphore(), renderFinished};
+	std::array<uint64_t, 2> signalValues = {signalValue, 0};		//Binary semaphores ignore their value
+	uint64_t waitValue = 0;
+
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.waitSemaphoreValueCount = headless ? 0 : 1;
+	timelineSubmitInfo.pWaitSemaphoreValues = &waitValue;
+	timelineSubmitInfo.signalSemaphoreValueCount = headless ? 1 : 2;
+	timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+
 	//Queue submission information
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;							//Number of semaphores to wait on
-	submitInfo.pWaitSemaphores = &imageAvailable[currentFrame];	//List of semaphores to wait on
+	submitInfo.pNext = &timelineSubmitInfo;
+	submitInfo.waitSemaphoreCount = headless ? 0 : 1;			//Number of semaphores to wait on (nothing to acquire offscreen)
+	submitInfo.pWaitSemaphores = &imageAvailable;				//List of semaphores to wait on
 	VkPipelineStageFlags waitStages[] = {
 		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
 	};
 	submitInfo.pWaitDstStageMask = waitStages;					//Stages when sync occurs
 	submitInfo.commandBufferCount = 1;							//Number of commandBuffers to submit
-	submitInfo.pCommandBuffers = &commandBuffers[imageIndex];	//CommandBuffers to submit
-	submitInfo.signalSemaphoreCount = 1;						//Number of semaphore to signal at end
-	submitInfo.pSignalSemaphores = &renderFinished[currentFrame];//Semaphores to signal when command buffers finish
+	submitInfo.pCommandBuffers = &commandBuffer;				//CommandBuffers to submit
+	submitInfo.signalSemaphoreCount = headless ? 1 : 2;			//Number of semaphore to signal at end (nobody presents offscreen)
+	submitInfo.pSignalSemaphores = signalSemaphores.data();		//Semaphores to signal when command buffers finish
 
-	//Submit command buffer to queue
-	VkResult result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, drawFences[currentFrame]);
+	//Submit command buffer to queue (no fence, the timeline value tells when it is done)
+	VkResult result;
+	{
+		TRACE_SCOPE("vkQueueSubmit");
+		result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	}
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to submit command buffers!");
 	}
+	frame.setSubmittedValue(signalValue);
+	framePacer.markSubmit();
+
+	lastFrame = currentFrame;
+	lastImageIndex = imageIndex;
+
+	if(headless)
+	{
+		currentFrame = (currentFrame + 1) % framesInFlight;
+		return;
+	}
 	
 	//3. Present image to screen when it has signalled finished rendering
 	//--PRESENT RENDERED IMAGE TO SCREEN--
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.waitSemaphoreCount = 1;							//Number of semaphores to wait on
-	presentInfo.pWaitSemaphores = &renderFinished[currentFrame];//Semaphores to wait on
+	presentInfo.pWaitSemaphores = &renderFinished;				//Semaphores to wait on
 	presentInfo.swapchainCount = 1;								//Number of swapchains to present to
 	presentInfo.pSwapchains = &swapChain;						//SwapChain to present image to
 	presentInfo.pImageIndices = &imageIndex;					//Index of images in swapchain to present
 	
 	//Present image
-	result = vkQueuePresentKHR(presentationQueue, &presentInfo);
-	if (result != VK_SUCCESS)
+	{
+		TRACE_SCOPE("vkQueuePresentKHR");
+		result = vkQueuePresentKHR(presentationQueue, &presentInfo);
+	}
+	framePacer.markPresent();
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
+	{
+		recreateSwapChain();
+	}
+	else if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to present image!");
 	}
 
-	//Get next frame (use % MAX_FRAME_DRAWS to keep the nuber of frame undert that limit)
-	//TODO-> fare diverso che coi nomi non si capisce
-	currentFrame = (currentFrame + 1) % MAX_FRAME_DRAWS;
+	//Get next frame (use % framesInFlight to keep the nuber of frame undert that limit)
+	currentFrame = (currentFrame + 1) % framesInFlight;
 }
 
 void VulkanRenderer::cleanup()
@@ -155,70 +852,87 @@ void VulkanRenderer::cleanup()
 	//Wait until no action being run on device before destroying
 	vkDeviceWaitIdle(mainDevice.logicalDevice);
 
+	//Everything removed at runtime first (it frees descriptor sets, geometry and device memory)
+	deletionQueue.flush(timeline, true);
+
 	// _aligned_free(modelTransferSpace);
 
-	vkDestroyDescriptorPool(mainDevice.logicalDevice, samplerDescriptorPool, nullptr);
-	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, samplerSetLayout, nullptr);
+	vkDestroyDescriptorPool(mainDevice.logicalDevice, samplerDescriptorPool, HostAllocator::getCallbacks());
+	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, samplerSetLayout, HostAllocator::getCallbacks());
 
-	vkDestroySampler(mainDevice.logicalDevice, textureSampler, nullptr);
+	vkDestroySampler(mainDevice.logicalDevice, textureSampler, HostAllocator::getCallbacks());
 
-	for(size_t i = 0; i < textureImages.size(); i++)
+	for(Texture& texture : textures)
 	{
-		vkDestroyImageView(mainDevice.logicalDevice, textureImageViews[i], nullptr);
-		vkDestroyImage(mainDevice.logicalDevice, textureImages[i], /*Memory management TODO*/nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, textureImagesMemory[i], /*Memory management TODO*/nullptr);
+		vkDestroyImageView(mainDevice.logicalDevice, texture.imageView, HostAllocator::getCallbacks());
+		vkDestroyImage(mainDevice.logicalDevice, texture.image, HostAllocator::getCallbacks());
+		deviceAllocator.free(texture.imageAllocation);
 	}
+	textures.clear();
 
-	vkDestroyImageView(mainDevice.logicalDevice, depthBufferImageView, nullptr);
-	vkDestroyImage(mainDevice.logicalDevice, depthBufferImage, nullptr);
-	vkFreeMemory(mainDevice.logicalDevice,depthBufferImageMemory, nullptr);
+	depthPyramid.destroy();
+	renderTargets.destroy();
 
-	vkDestroyDescriptorPool(mainDevice.logicalDevice, descriptorPool, nullptr);
-	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, descriptorSetLayout, nullptr);
+	vkDestroyDescriptorPool(mainDevice.logicalDevice, descriptorPool, HostAllocator::getCallbacks());
+	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, descriptorSetLayout, HostAllocator::getCallbacks());
 	
-	for(size_t i = 0; i < swapChainImages.size(); i++)
-	{
-		vkDestroyBuffer(mainDevice.logicalDevice, vpUniformBuffer[i], /*Memory management TODO*/nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, vpUniformBufferMemory[i], /*Memory management TODO*/nullptr);
-		// vkDestroyBuffer(mainDevice.logicalDevice, modelDynamicUniformBuffer[i], /*Memory management TODO*/nullptr);
-		// vkFreeMemory(mainDevice.logicalDevice, modelDynamicUniformBufferMemory[i], /*Memory management TODO*/nullptr);
-	}
 	
-	for(size_t i = 0; i < meshList.size(); i++)
+	for(Mesh& mesh : meshes)
 	{
-		meshList[i].destroyBuffers();
+		mesh.freeGeometry();
 	}
-	
+	meshes.clear();
+	instances.clear();
+	cullingPass.destroy();
+	instanceBuffer.destroy();
+	geometryPool.destroy();
+	uploadManager.destroy();
+
 	//Reverse order than creation
-	for(size_t i = 0; i < MAX_FRAME_DRAWS; i++)
+	recordWorkerPool.stop();
+	destroyFrameContexts();
+	timeline.destroy();
+	vkDestroyCommandPool(mainDevice.logicalDevice, graphicsCommandPool,HostAllocator::getCallbacks());
+	for(auto frameBuffer : swapChainFrameBuffers)
 	{
-		vkDestroySemaphore(mainDevice.logicalDevice, renderFinished[i], /*Memory management TODO*/nullptr);
-		vkDestroySemaphore(mainDevice.logicalDevice, imageAvailable[i], /*Memory management TODO*/nullptr);
-		vkDestroyFence(mainDevice.logicalDevice, drawFences[i], /*Memory management TODO*/nullptr);
+		vkDestroyFramebuffer(mainDevice.logicalDevice, frameBuffer,HostAllocator::getCallbacks());
 	}
-	vkDestroyCommandPool(mainDevice.logicalDevice, graphicsCommandPool,/*Memory management TODO*/nullptr);
-	for(auto frameBuffer : swapChainFrameBuffers)
+	vkDestroyPipeline(mainDevice.logicalDevice, graphicsPipeline,HostAllocator::getCallbacks());
+	vkDestroyPipelineLayout(mainDevice.logicalDevice,pipelineLayout,HostAllocator::getCallbacks());
+	vkDestroyRenderPass(mainDevice.logicalDevice, renderPass,HostAllocator::getCallbacks());
+	if(hasDepthPyramid)
+	{
+		for(auto occlusionRenderPass : occlusionRenderPasses)
+		{
+			vkDestroyRenderPass(mainDevice.logicalDevice, occlusionRenderPass, HostAllocator::getCallbacks());
+		}
+	}
+	if(headless)
+	{
+		destroyOffscreenTargets();
+	}
+	else
 	{
-		vkDestroyFramebuffer(mainDevice.logicalDevice, frameBuffer,/*Memory management TODO*/nullptr);
+		for(auto image : swapChainImages)
+		{
+			vkDestroyImageView(mainDevice.logicalDevice, image.imageView, HostAllocator::getCallbacks());
+		}
+		vkDestroySwapchainKHR(mainDevice.logicalDevice, swapChain, HostAllocator::getCallbacks());
 	}
-	vkDestroyPipeline(mainDevice.logicalDevice, graphicsPipeline,/*Memory management TODO*/nullptr);
-	vkDestroyPipelineLayout(mainDevice.logicalDevice,pipelineLayout,/*Memory management TODO*/nullptr);
-	vkDestroyRenderPass(mainDevice.logicalDevice, renderPass,/*Memory management TODO*/nullptr);
-	for(auto image : swapChainImages)
+	deviceAllocator.destroy();
+	vkDestroyDevice(mainDevice.logicalDevice,HostAllocator::getCallbacks());
+	if(!headless)
 	{
-		vkDestroyImageView(mainDevice.logicalDevice, image.imageView, /*Memory management TODO*/nullptr);
+		vkDestroySurfaceKHR(instance, surface,HostAllocator::getCallbacks());
 	}
-	vkDestroySwapchainKHR(mainDevice.logicalDevice, swapChain, /*Memory management TODO*/nullptr);
-	vkDestroyDevice(mainDevice.logicalDevice,/*Memory management TODO*/nullptr);
-	vkDestroySurfaceKHR(instance, surface,/*Memory management TODO*/nullptr);
 	//Destroy DebugUtilsMessanger
 	if (enableValidationLayers) {
 		auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
 		if (func != nullptr) {
-			func(instance, debugMessenger, /*Memory management TODO*/nullptr);
+			func(instance, debugMessenger, HostAllocator::getCallbacks());
 		}
 	}
-	vkDestroyInstance(instance,/*Memory management TODO*/nullptr);
+	vkDestroyInstance(instance,HostAllocator::getCallbacks());
 }
 
 VulkanRenderer::~VulkanRenderer()
@@ -240,7 +954,7 @@ void VulkanRenderer::createInstance()
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);	//Custom version of the application
 	appInfo.pEngineName = "No Engine";						//Custom engine name
 	appInfo.engineVersion= VK_MAKE_VERSION(1, 0, 0);		//Custom version of the engine
-	appInfo.apiVersion = VK_API_VERSION_1_0;				//Vulkan api version
+	appInfo.apiVersion = VK_API_VERSION_1_2;				//Vulkan api version (1.2: timeline semaphores in core)
 
 	//Creation information for a VkInstance
 	VkInstanceCreateInfo createInfo = {};
@@ -275,7 +989,7 @@ void VulkanRenderer::createInstance()
 	}
 
 	//Create instance with createInfo
-	VkResult result = vkCreateInstance(&createInfo, /*Memory management TODO*/nullptr, &instance);
+	VkResult result = vkCreateInstance(&createInfo, HostAllocator::getCallbacks(), &instance);
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create a Vulkan instance!");
@@ -289,16 +1003,24 @@ void VulkanRenderer::createLogicalDevice()
 
 	//Vector for queue creation infos, and set for family indices
 	std::vector< VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<int> queueFamilyIndices = { indices.graphicsFamily, indices.presentationFamily };
+	std::set<int> queueFamilyIndices = { indices.graphicsFamily };
+	if(!headless)
+	{
+		queueFamilyIndices.insert(indices.presentationFamily);
+	}
+	if(indices.transferFamily >= 0)
+	{
+		queueFamilyIndices.insert(indices.transferFamily);
+	}
 
 	//Queue the logical device needs to create and info to do so
+	float priority = 1.0f;		//Outside the loop: read at vkCreateDevice, after the loop
 	for (int queueFamilyIndex : queueFamilyIndices)
 	{
 		VkDeviceQueueCreateInfo queueCreateInfo = {};
 		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 		queueCreateInfo.queueFamilyIndex = queueFamilyIndex;						//The index of the family to create the queue from
 		queueCreateInfo.queueCount = 1;												//Number of queue to create
-		float priority = 1.0f;
 		queueCreateInfo.pQueuePriorities = &priority;								//Vulkan needs to know how to handle multiples queue, so decide priority (1=highest)
 
 		queueCreateInfos.push_back(queueCreateInfo);
@@ -308,8 +1030,15 @@ void VulkanRenderer::createLogicalDevice()
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());			//Number of queue create info
 	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();									//List of queue create info so device can create required queues
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());		//Number of enabled logical devices extensions
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();								//List of enabled logical device extensions
+	std::vector<const char*> requiredDeviceExtensions = getRequiredDeviceExtensions();
+	//Optional: heap budget/usage from the driver, the allocator estimates them without it
+	memoryBudgetSupported = isDeviceExtensionSupported(mainDevice.physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if(memoryBudgetSupported)
+	{
+		requiredDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(requiredDeviceExtensions.size());	//Number of enabled logical devices extensions
+	deviceCreateInfo.ppEnabledExtensionNames = requiredDeviceExtensions.data();							//List of enabled logical device extensions
 
 	//Physical device features the logical device will be using
 	VkPhysicalDeviceFeatures deviceFeatures = {};
@@ -317,9 +1046,44 @@ void VulkanRenderer::createLogicalDevice()
 
 	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;						//Physical device features the logical device will be using
 
+	//Vulkan 1.2 features are enabled through pNext
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.timelineSemaphore = VK_TRUE;			//Frame scheduling on one GPU progress counter
+	vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;	//Texture index differs per instance within a draw
+	vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;				//Texture array elements without a texture
+	vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;	//New textures while frames are in flight
+
+	//Optional: reset timestamp queries from the host, without it the GPU profiler stays disabled
+	VkPhysicalDeviceVulkan12Features supportedVulkan12Features = {};
+	supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+	supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supportedFeatures2.pNext = &supportedVulkan12Features;
+	vkGetPhysicalDeviceFeatures2(mainDevice.physicalDevice, &supportedFeatures2);
+
+	hostQueryResetSupported = supportedVulkan12Features.hostQueryReset == VK_TRUE;
+	vulkan12Features.hostQueryReset = supportedVulkan12Features.hostQueryReset;
+
+	//Optional: many draws per indirect call, each with its own firstInstance (instance range), else draws stay direct
+	indirectDrawSupported = supportedFeatures2.features.multiDrawIndirect == VK_TRUE
+		&& supportedFeatures2.features.drawIndirectFirstInstance == VK_TRUE;
+	deviceFeatures.multiDrawIndirect = supportedFeatures2.features.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures2.features.drawIndirectFirstInstance;
+
+	//Optional: draw count read from a GPU buffer, needed to draw what the culling pass kept
+	drawIndirectCountSupported = supportedVulkan12Features.drawIndirectCount == VK_TRUE;
+	vulkan12Features.drawIndirectCount = supportedVulkan12Features.drawIndirectCount;
+
+	//Optional: the depth pyramid is an rg32f storage image, without it there is no occlusion culling
+	occlusionCullingSupported = supportedFeatures2.features.shaderStorageImageExtendedFormats == VK_TRUE;
+	deviceFeatures.shaderStorageImageExtendedFormats = supportedFeatures2.features.shaderStorageImageExtendedFormats;
+
+	deviceCreateInfo.pNext = &vulkan12Features;
+
 
 	//Create the logical device from the given logical device
-	VkResult result = vkCreateDevice(mainDevice.physicalDevice, &deviceCreateInfo, /*Memory management TODO*/nullptr, &mainDevice.logicalDevice);
+	VkResult result = vkCreateDevice(mainDevice.physicalDevice, &deviceCreateInfo, HostAllocator::getCallbacks(), &mainDevice.logicalDevice);
 
 	if (result != VK_SUCCESS)
 	{
@@ -329,7 +1093,14 @@ void VulkanRenderer::createLogicalDevice()
 	//Queues are created at the same time as device...
 	//So we want handle to queues
 	vkGetDeviceQueue(mainDevice.logicalDevice, indices.graphicsFamily, 0, &graphicsQueue);				//Store the first logical device's queue in graphicsQueue
-	vkGetDeviceQueue(mainDevice.logicalDevice, indices.presentationFamily, 0, &presentationQueue);		//Store the first logical device's queue in presentationQueue
+	if(!headless)
+	{
+		vkGetDeviceQueue(mainDevice.logicalDevice, indices.presentationFamily, 0, &presentationQueue);	//Store the first logical device's queue in presentationQueue
+	}
+
+	//Staging copies go to the copy engine when there is one, else they share the graphics queue
+	transferQueueFamily = indices.transferFamily >= 0 ? indices.transferFamily : indices.graphicsFamily;
+	vkGetDeviceQueue(mainDevice.logicalDevice, transferQueueFamily, 0, &transferQueue);
 }
 
 void VulkanRenderer::createDebugMessenger()
@@ -346,7 +1117,7 @@ void VulkanRenderer::createDebugMessenger()
 	VkResult creationResult;
 	auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
 	if (func != nullptr) {
-		creationResult = func(instance, &createInfo, /*Memory management TODO*/nullptr, &debugMessenger);
+		creationResult = func(instance, &createInfo, HostAllocator::getCallbacks(), &debugMessenger);
 	}
 	else {
 		creationResult = VK_ERROR_EXTENSION_NOT_PRESENT;
@@ -359,7 +1130,7 @@ void VulkanRenderer::createDebugMessenger()
 void VulkanRenderer::createSurface()
 {
 	//Create surface (creating a surface createinfo struct, runs the create surface function system independant)
-	VkResult result=glfwCreateWindowSurface(instance,window,/*Memory allocator TODO*/nullptr,&surface);
+	VkResult result=glfwCreateWindowSurface(instance,window,HostAllocator::getCallbacks(),&surface);
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create a surface!");
@@ -426,10 +1197,10 @@ void VulkanRenderer::createSwapChain()
 	}
 
 	//If old swap chai need been destroyed and this one replace it, then link old one to quickly hand over responsibilities
-	swapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+	swapChainCreateInfo.oldSwapchain = swapChain;				//VK_NULL_HANDLE on first creation
 
 	//Create SwapChain
-	VkResult result = vkCreateSwapchainKHR(mainDevice.logicalDevice,&swapChainCreateInfo,/*Maemory allocation TODO*/nullptr,&swapChain);
+	VkResult result = vkCreateSwapchainKHR(mainDevice.logicalDevice,&swapChainCreateInfo,HostAllocator::getCallbacks(),&swapChain);
 
 	if(result != VK_SUCCESS)
 	{
@@ -458,6 +1229,78 @@ void VulkanRenderer::createSwapChain()
 	}
 }
 
+void VulkanRenderer::recreateSwapChain()
+{
+	//Minimized: no swapchain can be created with a 0 extent, retry on the next draw
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(window, &width, &height);
+	if(width == 0 || height == 0)
+	{
+		framebufferResized = true;
+		return;
+	}
+	framebufferResized = false;
+
+	//Size dependent resources may still be used by frames in flight: destroy them once the timeline passes the last submit
+	VkSwapchainKHR oldSwapChain = swapChain;
+	std::vector<VkFramebuffer> oldFrameBuffers = swapChainFrameBuffers;
+	std::vector<VkImageView> oldImageViews;
+	for(auto& image : swapChainImages)
+	{
+		oldImageViews.push_back(image.imageView);
+	}
+	AttachmentPool oldRenderTargets = renderTargets;
+	DepthPyramid oldDepthPyramid = depthPyramid;
+	deletionQueue.push(timeline.getLastSubmittedValue(), [=]() mutable {
+		for(auto frameBuffer : oldFrameBuffers)
+		{
+			vkDestroyFramebuffer(mainDevice.logicalDevice, frameBuffer, HostAllocator::getCallbacks());
+		}
+		for(auto imageView : oldImageViews)
+		{
+			vkDestroyImageView(mainDevice.logicalDevice, imageView, HostAllocator::getCallbacks());
+		}
+		oldDepthPyramid.destroyImages();
+		oldRenderTargets.destroy();
+		vkDestroySwapchainKHR(mainDevice.logicalDevice, oldSwapChain, HostAllocator::getCallbacks());
+	});
+
+	//New swapchain takes over from the old one (passed as oldSwapchain)
+	swapChainImages.clear();
+	createSwapChain();
+	createRenderTargets();
+	createFrameBuffers();
+
+	//Render pass, pipeline and descriptors don't depend on the size, only the recorded viewport and the projection do
+	updateProjection();
+	markCommandBuffersDirty();
+}
+
+void VulkanRenderer::createOffscreenTargets()
+{
+	//Offscreen colour format, same layout the readback returns
+	swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+	//One colour target per frame in flight, they take the place of the swapchain images
+	offscreenImagesAllocation.resize(framesInFlight);
+	for(size_t i = 0; i < framesInFlight; i++)
+	{
+		SwapChainImage offscreenImage = {};
+		offscreenImage.image = createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat,
+			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &offscreenImagesAllocation[i], MEMORY_CATEGORY_ATTACHMENTS);
+		offscreenImage.imageView = createImageView(offscreenImage.image, swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+
+		swapChainImages.push_back(offscreenImage);
+	}
+
+	//Host visible buffer the frames get copied into for readback
+	createBuffer(deviceAllocator, mainDevice.logicalDevice,
+		(VkDeviceSize)swapChainExtent.width * swapChainExtent.height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&readbackBuffer, &readbackBufferAllocation, MEMORY_CATEGORY_STAGING);
+}
+
 void VulkanRenderer::createRenderPass()
 {
 	//ATTACHMENTS
@@ -473,14 +1316,15 @@ void VulkanRenderer::createRenderPass()
 	//Framebuffer data will be stored as an image, but images can be given different data layouts
 	//to give optimal use for certain operation
 	colourAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;			//Image data layout before render pass start
-	colourAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;		//Image data layout after render pass (to change to)
+	colourAttachment.finalLayout = headless ?							//Image data layout after render pass (to change to)
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;	//Offscreen targets are only ever copied out
 
 	//Depth Attachment of render pass
 	VkAttachmentDescription depthAttachment = {};
-	depthAttachment.format = chooseSupportedFormat(
-		{VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT},
-		VK_IMAGE_TILING_OPTIMAL,
-		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	hasDepthPyramid = occlusionCulling && occlusionCullingSupported;
+	depthFormat = chooseDepthFormat(MIN_DEPTH_BITS, hasDepthPyramid ?
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT : VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	depthAttachment.format = depthFormat;
 	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -522,7 +1366,7 @@ void VulkanRenderer::createRenderPass()
 	subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 	subpassDependencies[0].dependencyFlags = 0;
 	
-	//Conversion from VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+	//Conversion from VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR (or TRANSFER_SRC when headless)
 	//Transition must happen after...
 	subpassDependencies[1].srcSubpass = 0;								
 	subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;	
@@ -545,11 +1389,111 @@ void VulkanRenderer::createRenderPass()
 	renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(subpassDependencies.size());
 	renderPassCreateInfo.pDependencies = subpassDependencies.data();
 
-	VkResult result = vkCreateRenderPass(mainDevice.logicalDevice, &renderPassCreateInfo, /*Memory management TODO*/nullptr, &renderPass);
+	VkResult result = vkCreateRenderPass(mainDevice.logicalDevice, &renderPassCreateInfo, HostAllocator::getCallbacks(), &renderPass);
 	if(result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create render pass!");
 	}
+
+	//Depth only lives inside this pass (cleared on load, never stored): transient, no memory needed on tilers
+	//Unless occlusion culling keeps it, to build the pyramid from it and load it in the second pass
+	AttachmentInfo depthInfo = {};
+	depthInfo.format = depthFormat;
+	depthInfo.usage = hasDepthPyramid ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT :
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	depthInfo.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+	depthInfo.firstPass = 0;
+	depthInfo.lastPass = hasDepthPyramid ? 1 : 0;
+	depthTarget = renderTargets.addAttachment(depthInfo);
+}
+
+void VulkanRenderer::createOcclusionRenderPasses()
+{
+	if(!hasDepthPyramid) return;
+
+	//Same attachments as the main render pass, only load/store ops and layouts differ
+	//0: clears both, keeps the depth readable by the pyramid build; 1: loads both and ends like the main render pass
+	for(uint32_t i = 0; i < occlusionRenderPasses.size(); i++)
+	{
+		bool first = i == 0;
+
+		VkAttachmentDescription colourAttachment = {};
+		colourAttachment.format = swapChainImageFormat;
+		colourAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		colourAttachment.loadOp = first ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+		colourAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colourAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		colourAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colourAttachment.initialLayout = first ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colourAttachment.finalLayout = first ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL :
+			(headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+		//Read only layout between the passes: the pyramid build samples it
+		VkAttachmentDescription depthAttachment = {};
+		depthAttachment.format = depthFormat;
+		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depthAttachment.loadOp = first ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+		depthAttachment.storeOp = first ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = first ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+		VkAttachmentReference colourAttachmentReference = {};
+		colourAttachmentReference.attachment = 0;
+		colourAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference depthAttachmentReference = {};
+		depthAttachmentReference.attachment = 1;
+		depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colourAttachmentReference;
+		subpass.pDepthStencilAttachment = &depthAttachmentReference;
+
+		std::array<VkSubpassDependency, 2> subpassDependencies;
+
+		//Attachments are written after the previous pass wrote them and the pyramid build read the depth
+		//(last frame's build for the first pass, this frame's for the second one)
+		subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		subpassDependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		subpassDependencies[0].dstSubpass = 0;
+		subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+			VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		subpassDependencies[0].dependencyFlags = 0;
+
+		//First pass: depth writes visible to the pyramid build; second pass: same as the main render pass
+		subpassDependencies[1].srcSubpass = 0;
+		subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		subpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		subpassDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		subpassDependencies[1].dstStageMask = first ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		subpassDependencies[1].dstAccessMask = first ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_MEMORY_READ_BIT;
+		subpassDependencies[1].dependencyFlags = 0;
+
+		std::array<VkAttachmentDescription, 2> renderPassAttachment = {colourAttachment, depthAttachment};
+
+		VkRenderPassCreateInfo renderPassCreateInfo = {};
+		renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(renderPassAttachment.size());
+		renderPassCreateInfo.pAttachments = renderPassAttachment.data();
+		renderPassCreateInfo.subpassCount = 1;
+		renderPassCreateInfo.pSubpasses = &subpass;
+		renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(subpassDependencies.size());
+		renderPassCreateInfo.pDependencies = subpassDependencies.data();
+
+		VkResult result = vkCreateRenderPass(mainDevice.logicalDevice, &renderPassCreateInfo, HostAllocator::getCallbacks(), &occlusionRenderPasses[i]);
+		if(result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create occlusion culling render pass!");
+		}
+	}
 }
 
 void VulkanRenderer::createDescriptorSetLayout()
@@ -558,7 +1502,7 @@ void VulkanRenderer::createDescriptorSetLayout()
 	//UboViewProjection Binding Info
 	VkDescriptorSetLayoutBinding vpLayoutBinding = {};
 	vpLayoutBinding.binding = 0;											//Binding point in shider (designated by binding point in shader)
-	vpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;		//Type of descriptor
+	vpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;	//Type of descriptor (dynamic: offset into the frame ring given at bind time)
 	vpLayoutBinding.descriptorCount = 1;									//Number of descriptors for binding
 	vpLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;				//Shader stage to bind to
 	vpLayoutBinding.pImmutableSamplers = nullptr;							//For textures: Can make sampler data unchangeable (immutable) by specifing in layout
@@ -571,7 +1515,23 @@ void VulkanRenderer::createDescriptorSetLayout()
 	// modelLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;					//Shader stage to bind to
 	// modelLayoutBinding.pImmutableSamplers = nullptr;								//For textures: Can make sampler data unchangeable (immutable) by specifing in layout
 
-	std::vector<VkDescriptorSetLayoutBinding> layoutBindings = {vpLayoutBinding/*, modelLayoutBinding*/};
+	//Instance buffer binding info
+	VkDescriptorSetLayoutBinding objectLayoutBinding = {};
+	objectLayoutBinding.binding = 1;
+	objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;		//Array of instances, size not known by the shader
+	objectLayoutBinding.descriptorCount = 1;
+	objectLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	objectLayoutBinding.pImmutableSamplers = nullptr;
+
+	//Visible list binding info (instance slots in draw order)
+	VkDescriptorSetLayoutBinding visibleLayoutBinding = {};
+	visibleLayoutBinding.binding = 2;
+	visibleLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	visibleLayoutBinding.descriptorCount = 1;
+	visibleLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	visibleLayoutBinding.pImmutableSamplers = nullptr;
+
+	std::vector<VkDescriptorSetLayoutBinding> layoutBindings = {vpLayoutBinding, objectLayoutBinding, visibleLayoutBinding/*, modelLayoutBinding*/};
 	
 	//Create Descriptor Set Layout with given bindings
 	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
@@ -580,7 +1540,7 @@ void VulkanRenderer::createDescriptorSetLayout()
 	layoutCreateInfo.pBindings = layoutBindings.data();								//Array of binding infos
 
 	//Create Descriptor Set Layout
-	VkResult result = vkCreateDescriptorSetLayout(mainDevice.logicalDevice, &layoutCreateInfo, nullptr, &descriptorSetLayout);
+	VkResult result = vkCreateDescriptorSetLayout(mainDevice.logicalDevice, &layoutCreateInfo, HostAllocator::getCallbacks(), &descriptorSetLayout);
 	if(result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to crate a descriptor set layout!");
@@ -591,34 +1551,37 @@ void VulkanRenderer::createDescriptorSetLayout()
 	VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
 	samplerLayoutBinding.binding = 0;
 	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerLayoutBinding.descriptorCount = 1;
+	samplerLayoutBinding.descriptorCount = textureArraySize;					//Bindless: every texture in one array
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	samplerLayoutBinding.pImmutableSamplers = nullptr;
 
+	//Elements are only written when textures are created, and may be while frames using other elements are in flight
+	VkDescriptorBindingFlags samplerBindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+	VkDescriptorSetLayoutBindingFlagsCreateInfo samplerBindingFlagsInfo = {};
+	samplerBindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	samplerBindingFlagsInfo.bindingCount = 1;
+	samplerBindingFlagsInfo.pBindingFlags = &samplerBindingFlags;
+
 	//Create a Descriptor set layout with given bindings for texture
 	VkDescriptorSetLayoutCreateInfo samplerLayoutCreateInfo = {};
 	samplerLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	samplerLayoutCreateInfo.pNext = &samplerBindingFlagsInfo;
 	samplerLayoutCreateInfo.bindingCount = 1;
 	samplerLayoutCreateInfo.pBindings = &samplerLayoutBinding;
 
 	//Create descriptor set layout
-	result = vkCreateDescriptorSetLayout(mainDevice.logicalDevice, &samplerLayoutCreateInfo, nullptr, &samplerSetLayout);
+	result = vkCreateDescriptorSetLayout(mainDevice.logicalDevice, &samplerLayoutCreateInfo, HostAllocator::getCallbacks(), &samplerSetLayout);
 	if(result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to crate sampler descriptor set layout!");
 	}
 }
 
-void VulkanRenderer::createPushConstantRange()
-{
-	//Define push constant values (no 'create' need)
-	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;		//Shader push constant will go to
-	pushConstantRange.offset = 0;									//Offset into given data to pass to push constant
-	pushConstantRange.size = sizeof(Model);							//Size of data being pass
-}
-
 void VulkanRenderer::createGraphicsPipeline()
 {
+	TRACE_SCOPE("createGraphicsPipeline");
+
 	//Read in SPIR-V code of shaders
 	auto vertexShaderCode = readFile("Shaders/vert.spv");
 	auto fragmentShaderCode = readFile("Shaders/frag.spv");
@@ -642,6 +1605,19 @@ void VulkanRenderer::createGraphicsPipeline()
 	fragmentShaderCreateInfo.module = fragmentShaderModule;											//Shader module to be used by stage
 	fragmentShaderCreateInfo.pName = "main";														//First function called on the shader (entry point)
 
+	//Length of the texture array (constant_id 0), the layout's descriptorCount
+	VkSpecializationMapEntry textureArraySizeEntry = {};
+	textureArraySizeEntry.constantID = 0;
+	textureArraySizeEntry.offset = 0;
+	textureArraySizeEntry.size = sizeof(uint32_t);
+
+	VkSpecializationInfo fragmentSpecializationInfo = {};
+	fragmentSpecializationInfo.mapEntryCount = 1;
+	fragmentSpecializationInfo.pMapEntries = &textureArraySizeEntry;
+	fragmentSpecializationInfo.dataSize = sizeof(uint32_t);
+	fragmentSpecializationInfo.pData = &textureArraySize;
+	fragmentShaderCreateInfo.pSpecializationInfo = &fragmentSpecializationInfo;
+
 	//Put shader stage creation info in an array
 	//Graphics pipeline creation info requires an array of that type
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderCreateInfo, fragmentShaderCreateInfo };
@@ -716,16 +1692,16 @@ void VulkanRenderer::createGraphicsPipeline()
 
 	
 	//--DYNAMIC STATES--
-	//Dynamic states to enable, not in use at the moment
-	// std::vector<VkDynamicState> dynamicStatesEnables;
-	// dynamicStatesEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);		//Dynamic viewport: can resize in command buffer with vkCmdSetViewport(commandBuffer, 0, 1, &viewport) --> tou have to RESIZE SWAPCHAIN AND BUFFER TOO
-	// dynamicStatesEnables.push_back(VK_DYNAMIC_STATE_SCISSOR);		//Dynamic scissor: can resize in command buffer with vkCmdSetScissor(commandBuffer, 0, 1, &scissor) --> tou have to RESIZE SWAPCHAIN AND BUFFER TOO
-	//
-	// //Dynamic state creation info
-	// VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
-	// dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	// dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStatesEnables.size());
-	// dynamicStateCreateInfo.pDynamicStates = dynamicStatesEnables.data();
+	//Viewport and scissor are set while recording, so the pipeline survives a swapchain resize
+	std::vector<VkDynamicState> dynamicStatesEnables;
+	dynamicStatesEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);		//Dynamic viewport: can resize in command buffer with vkCmdSetViewport(commandBuffer, 0, 1, &viewport)
+	dynamicStatesEnables.push_back(VK_DYNAMIC_STATE_SCISSOR);		//Dynamic scissor: can resize in command buffer with vkCmdSetScissor(commandBuffer, 0, 1, &scissor)
+
+	//Dynamic state creation info
+	VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
+	dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStatesEnables.size());
+	dynamicStateCreateInfo.pDynamicStates = dynamicStatesEnables.data();
 
 	
 	//--RASTERIZER--
@@ -778,11 +1754,17 @@ void VulkanRenderer::createGraphicsPipeline()
 	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
 	pipelineLayoutCreateInfo.pSetLayouts = descriptorSetLayouts.data();
+	//Model matrices come from the instance buffer, only where the vertex shader finds the instance slots is pushed
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(uint32_t);
+
 	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
 	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 
 	//Create Pipeline Layout
-	VkResult result = vkCreatePipelineLayout(mainDevice.logicalDevice, &pipelineLayoutCreateInfo, /*Memory management TODO*/nullptr, &pipelineLayout);
+	VkResult result = vkCreatePipelineLayout(mainDevice.logicalDevice, &pipelineLayoutCreateInfo, HostAllocator::getCallbacks(), &pipelineLayout);
 	if(result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create pipeline layout!");
@@ -806,8 +1788,7 @@ void VulkanRenderer::createGraphicsPipeline()
 	pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;		//All the fixed functions pipeline states
 	pipelineCreateInfo.pInputAssemblyState = &inputAssemblyCreateInfo;
 	pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
-	//Not created at the moment
-	pipelineCreateInfo.pDynamicState = nullptr;
+	pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
 	pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
 	pipelineCreateInfo.pMultisampleState = &multiSamplingCreateInfo;
 	pipelineCreateInfo.pColorBlendState = &colourBlendingCreateInfo;
@@ -821,32 +1802,31 @@ void VulkanRenderer::createGraphicsPipeline()
 	pipelineCreateInfo.basePipelineIndex = -1;							//or index of pipeline being created to derive from (in case creating multiple at once)
 
 	//Create graphics pipeline
-	result = vkCreateGraphicsPipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, /*Memory management TODO*/nullptr, &graphicsPipeline);
+	result = vkCreateGraphicsPipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, HostAllocator::getCallbacks(), &graphicsPipeline);
 	if(result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create a Graphics Pipeline!");
 	}
 	
 	//Destroy shader modules, no longer needed after pipeline creation (reverse order of creation)
-	vkDestroyShaderModule(mainDevice.logicalDevice, fragmentShaderModule, /*Memory management TODO*/nullptr);
-	vkDestroyShaderModule(mainDevice.logicalDevice, vertexShaderModule, /*Memory management TODO*/nullptr);
+	vkDestroyShaderModule(mainDevice.logicalDevice, fragmentShaderModule, HostAllocator::getCallbacks());
+	vkDestroyShaderModule(mainDevice.logicalDevice, vertexShaderModule, HostAllocator::getCallbacks());
 }
 
-void VulkanRenderer::createDepthBufferImage()
+void VulkanRenderer::createRenderTargets()
 {
-	//Get supported format for depth buffer
-	VkFormat depthFormat = chooseSupportedFormat(
-		{VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT},
-		VK_IMAGE_TILING_OPTIMAL,
-		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-
-	//Create depth buffer image
-	depthBufferImage = createImage(swapChainExtent.width, swapChainExtent.height,
-		depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthBufferImageMemory);
+	//Attachments were described with the render pass, create them at the current size
+	//(lazily allocated and aliased where possible)
+	renderTargets.create(&deviceAllocator, mainDevice.logicalDevice, swapChainExtent);
 
-	//Create depth buffer image view
-	depthBufferImageView = createImageView(depthBufferImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+	//Pyramid of the new depth, it only holds something once a frame built it
+	if(hasDepthPyramid)
+	{
+		depthPyramid.createImages(swapChainExtent, renderTargets.getImageView(depthTarget));
+		cullingPass.setDepthPyramid(depthPyramid.getImageView(), depthPyramid.getSampler(), depthPyramid.getExtent(),
+			depthPyramid.getLevelCount());
+		pyramidHistoryValid = false;
+	}
 }
 
 void VulkanRenderer::createFrameBuffers()
@@ -859,7 +1839,7 @@ void VulkanRenderer::createFrameBuffers()
 	{
 		std::array<VkImageView, 2> attachments = {
 			swapChainImages[i].imageView,
-			depthBufferImageView
+			renderTargets.getImageView(depthTarget)
 		}; //The order counts, as in the render pass creation!!
 		
 		VkFramebufferCreateInfo frameBufferCreateInfo = {};
@@ -871,7 +1851,7 @@ void VulkanRenderer::createFrameBuffers()
 		frameBufferCreateInfo.height = swapChainExtent.height;									//Framebuffer height
 		frameBufferCreateInfo.layers = 1;														//Framebuffer layers
 
-		VkResult result = vkCreateFramebuffer(mainDevice.logicalDevice, &frameBufferCreateInfo, /*Memory management TODO*/nullptr, &swapChainFrameBuffers[i]);
+		VkResult result = vkCreateFramebuffer(mainDevice.logicalDevice, &frameBufferCreateInfo, HostAllocator::getCallbacks(), &swapChainFrameBuffers[i]);
 		if(result != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create framebuffer!");
@@ -890,55 +1870,31 @@ void VulkanRenderer::createCommandPool()
 	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;		//Queue family type that buffers from this command pool will use
 
 	//Create a graphics queue family command pool
-	VkResult result = vkCreateCommandPool(mainDevice.logicalDevice, &poolInfo, /*Memory management TODO*/nullptr, &graphicsCommandPool);
+	VkResult result = vkCreateCommandPool(mainDevice.logicalDevice, &poolInfo, HostAllocator::getCallbacks(), &graphicsCommandPool);
 	if(result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create command pool!");
 	}
 }
 
-void VulkanRenderer::createCommandBuffers()
+void VulkanRenderer::createFrameContexts()
 {
-	//Resize Command buffer count to mach each framebuffer
-	commandBuffers.resize(swapChainFrameBuffers.size());
-
-	VkCommandBufferAllocateInfo cbAllocInfo = {};
-	cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cbAllocInfo.commandPool = graphicsCommandPool;
-	cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;					//VK_COMMAND_BUFFER_LEVEL_PRIMARY: Buffer you submit directly to queue, cant be called by other buffer - VK_COMMAND_BUFFER_LEVEL_Secondary: cant be called directly, but by other buffer
-	cbAllocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+	QueueFamilyIndices queueFamilyIndices = getQueueFamiliesIndices(mainDevice.physicalDevice);
 
-	//Allocate (NOT CREATE!) command buffers and place handles in array of buffers
-	VkResult result = vkAllocateCommandBuffers(mainDevice.logicalDevice, &cbAllocInfo, commandBuffers.data());
-	if(result != VK_SUCCESS)
+	//One context per frame in flight, everything in it is indexed by currentFrame
+	frames.resize(framesInFlight);
+	for(auto& frame : frames)
 	{
-		throw std::runtime_error("Failed to allocate command buffers!");
+		frame.create(&deviceAllocator, mainDevice.logicalDevice, queueFamilyIndices.graphicsFamily, recordThreadCount);
 	}
-}
-
-void VulkanRenderer::createSynchronization()
-{
-	imageAvailable.resize(MAX_FRAME_DRAWS);
-	renderFinished.resize(MAX_FRAME_DRAWS);
-	drawFences.resize(MAX_FRAME_DRAWS);
-	//Semaphore creation info
-	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
-	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	//Fence creation info
-	VkFenceCreateInfo fenceCreateInfo = {};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	//Timestamp queries are recycled with the frames, so they need one range per frame in flight
+	gpuProfiler.create(mainDevice.physicalDevice, mainDevice.logicalDevice, queueFamilyIndices.graphicsFamily,
+		framesInFlight, hostQueryResetSupported);
 
-	for(size_t i = 0; i < MAX_FRAME_DRAWS; i++)
-	{
-		if(vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, /*Memory management TODO*/nullptr, &imageAvailable[i]) != VK_SUCCESS ||
-		vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, /*Memory management TODO*/nullptr, &renderFinished[i]) != VK_SUCCESS ||
-		vkCreateFence(mainDevice.logicalDevice, &fenceCreateInfo, /*Memory management TODO*/nullptr, &drawFences[i]) != VK_SUCCESS)
-		{
-			throw std::runtime_error("Failed to create a Semaphore (and/or Fence)!");
-		}
-	}
+	currentFrame = 0;
+	lastFrame = 0;
+	lastImageIndex = 0;
 }
 
 void VulkanRenderer::createTextureSampler()
@@ -956,42 +1912,15 @@ void VulkanRenderer::createTextureSampler()
 	samplerCreateInfo.mipLodBias = 0.0f;									//LOD bias for mip levels
 	samplerCreateInfo.minLod = 0.0f;										//Min LOD to pick mip level
 	samplerCreateInfo.maxLod = 0.0f;										//Max LOD to pick mip level
-	samplerCreateInfo.anisotropyEnable = VK_TRUE;							//Enable anisotropy
-	samplerCreateInfo.maxAnisotropy = 16;									//Anisotropy sample level
-
-	VkResult result = vkCreateSampler(mainDevice.logicalDevice, &samplerCreateInfo, nullptr, &textureSampler);
-	if(result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Filed to create a Texture Sampler!");
-	}
-	
-}
-
-void VulkanRenderer::createUniformBuffers()
-{
-	//ViewProjection Buffer size
-	VkDeviceSize vpBufferSize = sizeof(UboViewProjection);
-
-	//Model Buffer size
-	// VkDeviceSize modelBufferSize = modelUniformAllignment * MAX_OBJECTS;
-
-	//One uniform buffer for each image (and by extension, command buffer)
-	vpUniformBuffer.resize(swapChainImages.size());
-	vpUniformBufferMemory.resize(swapChainImages.size());
-	// modelDynamicUniformBuffer.resize(swapChainImages.size());
-	// modelDynamicUniformBufferMemory.resize(swapChainImages.size());
+	samplerCreateInfo.anisotropyEnable = VK_TRUE;							//Enable anisotropy
+	samplerCreateInfo.maxAnisotropy = 16;									//Anisotropy sample level
 
-	//Create uniform buffers
-	for(size_t i = 0; i < swapChainImages.size(); i++)
+	VkResult result = vkCreateSampler(mainDevice.logicalDevice, &samplerCreateInfo, HostAllocator::getCallbacks(), &textureSampler);
+	if(result != VK_SUCCESS)
 	{
-		createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, vpBufferSize,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&vpUniformBuffer[i], &vpUniformBufferMemory[i]);
-		
-		// createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, modelBufferSize,
-		// 	VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		// 	&modelDynamicUniformBuffer[i], &modelDynamicUniformBufferMemory[i]);
+		throw std::runtime_error("Filed to create a Texture Sampler!");
 	}
+	
 }
 
 void VulkanRenderer::createDescriptorPool()
@@ -1001,26 +1930,31 @@ void VulkanRenderer::createDescriptorPool()
 	//Type of descriptors + how many DESCRIPTORS, not Descriptor Sets (combined makes the pool size)
 	//ViewProjection Pool
 	VkDescriptorPoolSize vpPoolSize = {};
-	vpPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	vpPoolSize.descriptorCount = static_cast<uint32_t>(vpUniformBuffer.size());
+	vpPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	vpPoolSize.descriptorCount = MAX_FRAMES_IN_FLIGHT;				//Enough for any frames in flight depth
 
 	// //Model Pool (Dynamic)
 	// VkDescriptorPoolSize modelPoolSize = {};
 	// modelPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	// modelPoolSize.descriptorCount = static_cast<uint32_t>(modelDynamicUniformBuffer.size());
 
+	//Instance Pool
+	VkDescriptorPoolSize objectPoolSize = {};
+	objectPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	objectPoolSize.descriptorCount = 2 * MAX_FRAMES_IN_FLIGHT;						//Instances + visible list
+
 	//List of Pool size
-	std::vector<VkDescriptorPoolSize> descriptorPoolSizes = {vpPoolSize/*, modelPoolSize*/};
+	std::vector<VkDescriptorPoolSize> descriptorPoolSizes = {vpPoolSize, objectPoolSize/*, modelPoolSize*/};
 	
 	//Data to create descriptor pool
 	VkDescriptorPoolCreateInfo poolCreateInfo = {};
 	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolCreateInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());					//Max num of descriptor sets thet can be created from the pool
+	poolCreateInfo.maxSets = MAX_FRAMES_IN_FLIGHT;											//Max num of descriptor sets thet can be created from the pool
 	poolCreateInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());		//Amount of Pool Sizes being passed
 	poolCreateInfo.pPoolSizes = descriptorPoolSizes.data();									//Pool Sizes to create pool with
 
 	//Create descriptor pool
-	VkResult result = vkCreateDescriptorPool(mainDevice.logicalDevice, &poolCreateInfo, nullptr, &descriptorPool);
+	VkResult result = vkCreateDescriptorPool(mainDevice.logicalDevice, &poolCreateInfo, HostAllocator::getCallbacks(), &descriptorPool);
 	if(result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create a descriptor pool!");
@@ -1029,35 +1963,51 @@ void VulkanRenderer::createDescriptorPool()
 	//CREATE SAMPLER DESCRIPTOR POOL
 	//Texture sampler pool
 	VkDescriptorPoolSize samplerPoolSize = {};
-	samplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;							//Not really optimal
-	samplerPoolSize.descriptorCount = MAX_OBJECTS;
+	samplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	samplerPoolSize.descriptorCount = textureArraySize;
 
-	//Data to create sampler descriptor pool
+	//Data to create sampler descriptor pool (one set: the texture array)
 	VkDescriptorPoolCreateInfo samplerPoolCreateInfo = {};
 	samplerPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	samplerPoolCreateInfo.maxSets = MAX_OBJECTS;					
+	samplerPoolCreateInfo.maxSets = 1;
 	samplerPoolCreateInfo.poolSizeCount = 1;		
 	samplerPoolCreateInfo.pPoolSizes = &samplerPoolSize;									
 
-	result = vkCreateDescriptorPool(mainDevice.logicalDevice, &samplerPoolCreateInfo, nullptr, &samplerDescriptorPool);
+	result = vkCreateDescriptorPool(mainDevice.logicalDevice, &samplerPoolCreateInfo, HostAllocator::getCallbacks(), &samplerDescriptorPool);
 	if(result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create sampler descriptor pool!");
 	}
 }
 
+void VulkanRenderer::createTextureDescriptorSet()
+{
+	//The only set of the sampler pool, elements are written as textures are created
+	VkDescriptorSetAllocateInfo setAllocInfo = {};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = samplerDescriptorPool;
+	setAllocInfo.descriptorSetCount = 1;
+	setAllocInfo.pSetLayouts = &samplerSetLayout;
+
+	VkResult result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &setAllocInfo, &textureDescriptorSet);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate Texture Descriptor Set!");
+	}
+}
+
 void VulkanRenderer::createDescriptorSets()
 {
-	//Resize descriptor sets list so one for each buffer
-	descriptorSets.resize(swapChainImages.size());
+	//One descriptor set for each frame (pointing at its ring buffer)
+	std::vector<VkDescriptorSet> descriptorSets(frames.size());
 
-	std::vector<VkDescriptorSetLayout> setLayouts(swapChainImages.size(), descriptorSetLayout);
+	std::vector<VkDescriptorSetLayout> setLayouts(frames.size(), descriptorSetLayout);
 
 	//Descriptor set allocation info
 	VkDescriptorSetAllocateInfo setAllocInfo = {};
 	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	setAllocInfo.descriptorPool = descriptorPool;									//Pool to allocate descriptor sets from
-	setAllocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());//Number of sets to allocate
+	setAllocInfo.descriptorSetCount = static_cast<uint32_t>(frames.size());		//Number of sets to allocate
 	setAllocInfo.pSetLayouts = setLayouts.data();									//Layouts to use to allocate sets (1:1 relationship)
 
 	//Allocate descriptor sets
@@ -1068,13 +2018,15 @@ void VulkanRenderer::createDescriptorSets()
 	}
 
 	//Update all of descriptor set buffer binding
-	for(size_t i = 0; i < swapChainImages.size(); i++)
+	for(size_t i = 0; i < frames.size(); i++)
 	{
+		frames[i].setDescriptorSet(descriptorSets[i]);
+
 		//View PROJECTION DESCRIPTOR
 		//Buffer info and data offset info
 		VkDescriptorBufferInfo vpBufferInfo = {};
-		vpBufferInfo.buffer = vpUniformBuffer[i];		//Buffer to get data from
-		vpBufferInfo.offset = 0;						//Position of start of data
+		vpBufferInfo.buffer = frames[i].getRingBuffer().getBuffer();	//Buffer to get data from
+		vpBufferInfo.offset = 0;						//Position of start of data (plus dynamic offset at bind time)
 		vpBufferInfo.range = sizeof(UboViewProjection);	//Size of data
 
 		//Data about connection between binding and buffer
@@ -1083,10 +2035,40 @@ void VulkanRenderer::createDescriptorSets()
 		vpSetWrite.dstSet = descriptorSets[i];							//Descriptor set to update
 		vpSetWrite.dstBinding = 0;										//Binding to update (has to match with shader/layout)
 		vpSetWrite.dstArrayElement = 0;								//Index in array to update
-		vpSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;	//Type of descriptor
+		vpSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;	//Type of descriptor
 		vpSetWrite.descriptorCount = 1;								//Amount to update
 		vpSetWrite.pBufferInfo = &vpBufferInfo;						//Info about buffer data to bind
 
+		//INSTANCE DESCRIPTOR (the frame's own copy of the instance data)
+		VkDescriptorBufferInfo objectBufferInfo = {};
+		objectBufferInfo.buffer = instanceBuffer.getBuffer(static_cast<uint32_t>(i));
+		objectBufferInfo.offset = 0;
+		objectBufferInfo.range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet objectSetWrite = {};
+		objectSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		objectSetWrite.dstSet = descriptorSets[i];
+		objectSetWrite.dstBinding = 1;
+		objectSetWrite.dstArrayElement = 0;
+		objectSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		objectSetWrite.descriptorCount = 1;
+		objectSetWrite.pBufferInfo = &objectBufferInfo;
+
+		//VISIBLE LIST DESCRIPTOR (written by the frame's culling pass)
+		VkDescriptorBufferInfo visibleBufferInfo = {};
+		visibleBufferInfo.buffer = cullingPass.getVisibleBuffer(static_cast<uint32_t>(i));
+		visibleBufferInfo.offset = 0;
+		visibleBufferInfo.range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet visibleSetWrite = {};
+		visibleSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		visibleSetWrite.dstSet = descriptorSets[i];
+		visibleSetWrite.dstBinding = 2;
+		visibleSetWrite.dstArrayElement = 0;
+		visibleSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		visibleSetWrite.descriptorCount = 1;
+		visibleSetWrite.pBufferInfo = &visibleBufferInfo;
+
 		// //Model DESCRIPTOR
 		// //Model Buffer info and data offset info
 		// VkDescriptorBufferInfo modelBufferInfo = {};
@@ -1105,20 +2087,49 @@ void VulkanRenderer::createDescriptorSets()
 		// modelSetWrite.pBufferInfo = &modelBufferInfo;							//Info about buffer data to bind
 
 		//List of descriptor sets write
-		std::vector<VkWriteDescriptorSet> setWrites = {vpSetWrite/*, modelSetWrite*/};
+		std::vector<VkWriteDescriptorSet> setWrites = {vpSetWrite, objectSetWrite, visibleSetWrite/*, modelSetWrite*/};
 		
 		//Update the descriptor set with new buffer/binding info
 		vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
 	}
 }
 
-void VulkanRenderer::updateUniformBuffers(uint32_t imageIndex)
+void VulkanRenderer::updateProjection()
 {
-	//Copy VP data
-	void * data;
-	vkMapMemory(mainDevice.logicalDevice, vpUniformBufferMemory[imageIndex], 0, sizeof(UboViewProjection), 0, &data);
-	memcpy(data, &uboViewProjection, sizeof(UboViewProjection));
-	vkUnmapMemory(mainDevice.logicalDevice, vpUniformBufferMemory[imageIndex]);
+	uboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 100.0f);
+	uboViewProjection.projection[1][1] *= -1; //Vulkan by default invert y coordinate
+}
+
+void VulkanRenderer::updateUniformBuffers(uint32_t frameIndex)
+{
+	TRACE_SCOPE("updateUniformBuffers");
+
+	//Ring was reset by beginFrame, once the GPU finished with the previous use of this frame
+	RingBuffer& ring = frames[frameIndex].getRingBuffer();
+
+	//Copy VP data (ring is persistently mapped, no map/unmap)
+	RingAllocation vpData = ring.allocate(sizeof(UboViewProjection), minUniformBufferOffset);
+	memcpy(vpData.data, &uboViewProjection, sizeof(UboViewProjection));
+
+	//Instance data written since this frame last ran (only the changed slots are copied)
+	instanceBuffer.sync(frameIndex);
+
+	frames[frameIndex].setDataOffsets({static_cast<uint32_t>(vpData.offset)});
+
+	//GPU culling builds the visible list and draws in a compute pass, CPU culling leaves out what it culled
+	//when recording direct draws, otherwise the frame's indirect table draws every instance
+	if(isGpuCulling())
+	{
+		writeCullData(frameIndex);
+	}
+	else if(isCpuCulling())
+	{
+		cullOnHost();
+	}
+	else if(isIndirectDrawing())
+	{
+		writeDrawCommands(frameIndex);
+	}
 
 	//NOT IN USE ANYMORE (Model used not with UBOD, but with push_constant)
 	// //Copy Model data
@@ -1134,19 +2145,25 @@ void VulkanRenderer::updateUniformBuffers(uint32_t imageIndex)
 	// vkUnmapMemory(mainDevice.logicalDevice, modelDynamicUniformBufferMemory[imageIndex]);
 }
 
-void VulkanRenderer::recordCommands(uint32_t currentImage)
+void VulkanRenderer::recordCommands(uint32_t frameIndex, uint32_t imageIndex)
 {
+	TRACE_SCOPE("recordCommands");
+
+	FrameContext& frame = frames[frameIndex];
+	VkCommandBuffer commandBuffer = frame.getCommandBuffer();
+
 	//Information about to begin each command buffer
 	VkCommandBufferBeginInfo bufferBeginInfo = {};
 	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;		//Re-recorded every frame
 
-	//Not relevant with fences introducted and MAX_FRAME_DRAWS = 2
-	//bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;	//Buffer can be resubmitted when it has already benn submitted during the execution
+	//Occlusion culling splits the frame in two passes around the pyramid build
+	bool occlusionCullingFrame = isOcclusionCulling();
 
 	//Information about how to begin a render pass (only needed for graphical application)
 	VkRenderPassBeginInfo renderPassBeginInfo = {};
 	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassBeginInfo.renderPass = renderPass;							//Render pass to begin
+	renderPassBeginInfo.renderPass = occlusionCullingFrame ? occlusionRenderPasses[0] : renderPass;	//Render pass to begin
 	renderPassBeginInfo.renderArea.offset = { 0, 0 };				//Start point of render pass in pixels
 	renderPassBeginInfo.renderArea.extent = swapChainExtent;				//Size of region to run render pass on (starting at offset)
 
@@ -1158,66 +2175,352 @@ void VulkanRenderer::recordCommands(uint32_t currentImage)
 	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 	
 	
-	renderPassBeginInfo.framebuffer = swapChainFrameBuffers[currentImage];
+	renderPassBeginInfo.framebuffer = swapChainFrameBuffers[imageIndex];
 	
 	//Start recording commands to command buffer
-	VkResult result = vkBeginCommandBuffer(commandBuffers[currentImage],&bufferBeginInfo);
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &bufferBeginInfo);
 	if(result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to start recording command buffers!");
 	}
 
-		//Begin render pass
-		vkCmdBeginRenderPass(commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		//Visible list (and draws) of this frame, compute can't run inside the render pass
+		if(isGpuCulling())
+		{
+			uint32_t cullingScope = gpuProfiler.beginScope(commandBuffer, "Culling");
+			cullingPass.record(commandBuffer, frameIndex);
+			gpuProfiler.endScope(commandBuffer, cullingScope);
+		}
 
-			//Bind pipeline to be use in render pass
-			vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		//Timestamps go outside the pass: a pass with secondary contents only allows vkCmdExecuteCommands
+		uint32_t renderPassScope = gpuProfiler.beginScope(commandBuffer, "Main render pass");
 
-			for(size_t j = 0; j < meshList.size(); j++)
+		//Begin render pass, draws come from the workers' secondary command buffers
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+			//Execute in worker order so draw order matches the mesh table
+			std::vector<VkCommandBuffer> secondaryCommandBuffers;
+			for(uint32_t i = 0; i < frame.getRecordedSecondaryCount(); i++)
+			{
+				secondaryCommandBuffers.push_back(frame.getSecondaryCommandBuffer(i));
+			}
+			if(!secondaryCommandBuffers.empty())
 			{
-				VkBuffer vertexBuffer[] = {meshList[j].getVertexBuffer()};									//Buffers to bind
-				VkDeviceSize offsets[] = {0};																//Offsets into buffers being bound
-				vkCmdBindVertexBuffers(commandBuffers[currentImage], 0, 1, vertexBuffer, offsets);	//Command to bind vertex buffer whith them
-
-				//Bind mesh index buffer, with 0 offset using uint32 type
-				vkCmdBindIndexBuffer(commandBuffers[currentImage], meshList[j].getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
-
-				// //Dynamic offset amount
-				// uint32_t dynamicOffset = static_cast<uint32_t>(modelUniformAllignment) * j;
-
-				//"Push" constant to given shader stage directly (no buffer)
-				vkCmdPushConstants(
-					commandBuffers[currentImage],
-					pipelineLayout,
-					VK_SHADER_STAGE_VERTEX_BIT,				//Stage to push constant to
-					0,										//Offset of push constant to update
-					sizeof(Model),							//Size of data being pushed
-					meshList[j].getModelPointer());				//Actual data being pushed
-
-				std::array<VkDescriptorSet, 2> descriptorSetGroup = {
-					descriptorSets[currentImage],
-					samplerDescriptorSets[meshList[j].getTexId()]
-				};
-				
-				//Bind descriptor sets
-				vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-					0, static_cast<uint32_t>(descriptorSetGroup.size()), descriptorSetGroup.data(), 0, nullptr);
-				
-				//Execute pipeline
-				vkCmdDrawIndexed(commandBuffers[currentImage], meshList[j].getIndexCount(), 1, 0, 0, 0);
+				vkCmdExecuteCommands(commandBuffer,
+					static_cast<uint32_t>(secondaryCommandBuffers.size()), secondaryCommandBuffers.data());
 			}
 			
 		//End render pass
-		vkCmdEndRenderPass(commandBuffers[currentImage]);
+		vkCmdEndRenderPass(commandBuffer);
+
+		gpuProfiler.endScope(commandBuffer, renderPassScope);
+
+		if(occlusionCullingFrame)
+		{
+			//Pyramid of what the main pass drew, the candidates it skipped are tested against it
+			uint32_t pyramidScope = gpuProfiler.beginScope(commandBuffer, "Depth pyramid");
+			depthPyramid.record(commandBuffer);
+			gpuProfiler.endScope(commandBuffer, pyramidScope);
+
+			uint32_t occlusionScope = gpuProfiler.beginScope(commandBuffer, "Occlusion culling");
+			cullingPass.recordDisoccluded(commandBuffer, frameIndex);
+			gpuProfiler.endScope(commandBuffer, occlusionScope);
+
+			//Few draws, recorded inline: one indirect count call reading the disoccluded half
+			uint32_t disoccludedScope = gpuProfiler.beginScope(commandBuffer, "Disoccluded render pass");
+			renderPassBeginInfo.renderPass = occlusionRenderPasses[1];
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				recordDrawState(commandBuffer, frameIndex);
+				vkCmdDrawIndexedIndirectCount(commandBuffer,
+					cullingPass.getDrawBuffer(frameIndex), cullingPass.getDrawOffset(CULL_PASS_DISOCCLUDED),
+					cullingPass.getCountBuffer(frameIndex), cullingPass.getCountOffset(CULL_PASS_DISOCCLUDED),
+					static_cast<uint32_t>(meshes.size()), sizeof(VkDrawIndexedIndirectCommand));
+
+			vkCmdEndRenderPass(commandBuffer);
+			gpuProfiler.endScope(commandBuffer, disoccludedScope);
+		}
+
+		//Next frame's main pass tests against this frame's depth, with the camera it was rendered with
+		pyramidHistoryValid = occlusionCullingFrame;
+		pyramidViewProjection = uboViewProjection.projection * uboViewProjection.view;
 	
 	//Stop recording to command buffer
-	result = vkEndCommandBuffer(commandBuffers[currentImage]);
+	result = vkEndCommandBuffer(commandBuffer);
 	if(result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to stop recording command buffers!");
 	}
 }
 
+void VulkanRenderer::recordDrawCommands(uint32_t frameIndex)
+{
+	TRACE_SCOPE("recordDrawCommands");
+
+	//Indirect: a single draw call for the whole table, nothing worth spreading over the workers
+	//(CPU culling records direct draws, see recordMeshRange)
+	if(isIndirectDrawing() && !isCpuCulling())
+	{
+		recordMeshRange(0, frameIndex, 0, meshes.size());
+		frames[frameIndex].markRecorded(meshes.empty() ? 0 : 1);
+		return;
+	}
+
+	//Split meshes in contiguous ranges, one per worker
+	size_t meshesPerWorker = (meshes.size() + recordThreadCount - 1) / recordThreadCount;
+
+	recordWorkerPool.execute([&](uint32_t workerIndex) {
+		size_t firstMesh = std::min(meshes.size(), workerIndex * meshesPerWorker);
+		size_t lastMesh = std::min(meshes.size(), firstMesh + meshesPerWorker);
+		recordMeshRange(workerIndex, frameIndex, firstMesh, lastMesh);
+	});
+
+	//Empty ranges recorded nothing and are all at the end, so only the first ones get executed
+	uint32_t usedSecondaryCount = 0;
+	while(usedSecondaryCount < recordThreadCount && usedSecondaryCount * meshesPerWorker < meshes.size())
+	{
+		usedSecondaryCount++;
+	}
+	frames[frameIndex].markRecorded(usedSecondaryCount);
+}
+
+void VulkanRenderer::recordMeshRange(uint32_t workerIndex, uint32_t frameIndex, size_t firstMesh, size_t lastMesh)
+{
+	//Nothing to draw for this worker, its buffer won't be executed
+	if(firstMesh >= lastMesh)
+	{
+		return;
+	}
+
+	TRACE_SCOPE("recordMeshRange");
+
+	FrameContext& frame = frames[frameIndex];
+	VkCommandBuffer commandBuffer = frame.getSecondaryCommandBuffer(workerIndex);
+
+	//Secondary buffers inherit the render pass state from the primary buffer
+	//Framebuffer left unspecified: the same draws are executed on whichever image gets acquired
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+
+	VkCommandBufferBeginInfo bufferBeginInfo = {};
+	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;		//Entirely inside a render pass
+	bufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &bufferBeginInfo);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to start recording secondary command buffer!");
+	}
+
+		//Pipeline and dynamic state are not inherited, every secondary buffer binds its own
+		recordDrawState(commandBuffer, frameIndex);
+
+		//GPU culling: the draws the culling pass compacted, how many is only known on the GPU
+		if(isGpuCulling())
+		{
+			vkCmdDrawIndexedIndirectCount(commandBuffer,
+				cullingPass.getDrawBuffer(frameIndex), cullingPass.getDrawOffset(CULL_PASS_MAIN),
+				cullingPass.getCountBuffer(frameIndex), cullingPass.getCountOffset(CULL_PASS_MAIN),
+				static_cast<uint32_t>(lastMesh - firstMesh), sizeof(VkDrawIndexedIndirectCommand));
+		}
+		//CPU culling: one draw per run of visible instances, firstInstance = slot of its first one
+		//(recordings are redone whenever the visibility changes, see cullOnHost)
+		else if(isCpuCulling())
+		{
+			for(size_t j = firstMesh; j < lastMesh; j++)
+			{
+				Mesh& mesh = meshes.at(j);
+				if(!mesh.isResident()) continue;
+
+				GeometryRange range = mesh.getGeometryRange();
+				uint32_t slot = mesh.getInstanceOffset();
+				uint32_t endSlot = slot + mesh.getInstanceCount();
+				while(slot < endSlot)
+				{
+					//Skip the culled instances, then draw the visible ones that follow
+					while(slot < endSlot && !isHostVisible(slot)) slot++;
+					uint32_t firstVisible = slot;
+					while(slot < endSlot && isHostVisible(slot)) slot++;
+
+					if(slot > firstVisible)
+					{
+						vkCmdDrawIndexed(commandBuffer, range.indexCount, slot - firstVisible, range.firstIndex,
+							static_cast<int32_t>(range.vertexOffset), firstVisible);
+					}
+				}
+			}
+		}
+		//Indirect: the frame's draw commands say what each mesh draws (meshes that are uploading draw no instances),
+		//so the same call stays valid while residency and instance counts change
+		else if(isIndirectDrawing())
+		{
+			VkDeviceSize commandOffset = frame.getDrawCommandOffset() + firstMesh * sizeof(VkDrawIndexedIndirectCommand);
+			vkCmdDrawIndexedIndirect(commandBuffer, frame.getRingBuffer().getBuffer(), commandOffset,
+				static_cast<uint32_t>(lastMesh - firstMesh), sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else
+		{
+			for(size_t j = firstMesh; j < lastMesh; j++)
+			{
+				//Dense table: the range only holds live meshes, but some may still be uploading
+				Mesh& mesh = meshes.at(j);
+				if(!mesh.isResident() || mesh.getInstanceCount() == 0) continue;
+
+				//Execute pipeline, one draw for all the mesh's instances (firstInstance = start of its range in the instance buffer)
+				//Mesh indices are local to the mesh, vertexOffset moves them to its range in the pool
+				GeometryRange range = mesh.getGeometryRange();
+				vkCmdDrawIndexed(commandBuffer, range.indexCount, mesh.getInstanceCount(), range.firstIndex,
+					static_cast<int32_t>(range.vertexOffset), mesh.getInstanceOffset());
+			}
+		}
+
+	result = vkEndCommandBuffer(commandBuffer);
+	if(result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to stop recording secondary command buffer!");
+	}
+}
+
+void VulkanRenderer::recordDrawState(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	FrameContext& frame = frames[frameIndex];
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+	VkViewport viewport = {};
+	viewport.width = (float)swapChainExtent.width;
+	viewport.height = (float)swapChainExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.offset = {0,0};
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	//Every mesh lives in the same vertex/index buffers, bind them once for the whole range
+	geometryPool.bind(commandBuffer);
+
+	//Textures are picked per instance from the bindless array, so the sets are the same for every draw
+	std::array<VkDescriptorSet, 2> descriptorSetGroup = {
+		frame.getDescriptorSet(),
+		textureDescriptorSet
+	};
+
+	//Bind descriptor sets (dynamic offset of the VP data)
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+		0, static_cast<uint32_t>(descriptorSetGroup.size()), descriptorSetGroup.data(),
+		static_cast<uint32_t>(frame.getDataOffsets().size()), frame.getDataOffsets().data());
+
+	//Instance slots: through the visible list the culling pass built, else gl_InstanceIndex is the slot itself
+	uint32_t visibleList = isGpuCulling() ? 1 : 0;
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &visibleList);
+}
+
+void VulkanRenderer::writeDrawCommands(uint32_t frameIndex)
+{
+	//Same size every frame while the table doesn't change, so the offset (baked in the recording) stays the same too
+	RingAllocation commandData = frames[frameIndex].getRingBuffer().allocate(
+		sizeof(VkDrawIndexedIndirectCommand) * std::max(meshes.size(), (size_t)1), sizeof(uint32_t));
+	VkDrawIndexedIndirectCommand* commands = (VkDrawIndexedIndirectCommand*)commandData.data;
+
+	for(size_t i = 0; i < meshes.size(); i++)
+	{
+		//Instances are read in the shader through gl_InstanceIndex, which starts at firstInstance
+		Mesh& mesh = meshes.at(i);
+		GeometryRange range = mesh.getGeometryRange();
+		commands[i].indexCount = range.indexCount;
+		commands[i].instanceCount = mesh.isResident() ? mesh.getInstanceCount() : 0;
+		commands[i].firstIndex = range.firstIndex;
+		commands[i].vertexOffset = static_cast<int32_t>(range.vertexOffset);
+		commands[i].firstInstance = mesh.getInstanceOffset();
+	}
+
+	frames[frameIndex].setDrawCommandOffset(commandData.offset);
+}
+
+void VulkanRenderer::writeCullData(uint32_t frameIndex)
+{
+	//One entry per handle slot, instances find their mesh by handle index
+	uint32_t meshCount = static_cast<uint32_t>(meshes.capacity());
+	cullingPass.update(frameIndex, uboViewProjection.projection * uboViewProjection.view, CULL_MODE_FRUSTUM, meshCount);
+	if(isOcclusionCulling() && pyramidHistoryValid)
+	{
+		cullingPass.setOcclusionTest(frameIndex, pyramidViewProjection);
+	}
+
+	//Free slots draw nothing
+	MeshCullData* meshData = cullingPass.getMeshData(frameIndex);
+	std::fill(meshData, meshData + meshCount, MeshCullData());
+
+	for(size_t i = 0; i < meshes.size(); i++)
+	{
+		Mesh& mesh = meshes.at(i);
+		GeometryRange range = mesh.getGeometryRange();
+		MeshCullData& data = meshData[meshes.getHandle(i).index];
+		data.bounds = mesh.getBounds();
+		data.indexCount = range.indexCount;
+		data.firstIndex = range.firstIndex;
+		data.vertexOffset = static_cast<int32_t>(range.vertexOffset);
+		data.instanceOffset = mesh.getInstanceOffset();
+		data.instanceCount = mesh.isResident() ? mesh.getInstanceCount() : 0;
+	}
+}
+
+void VulkanRenderer::cullOnHost()
+{
+	TRACE_SCOPE("cullOnHost");
+
+	frustumCuller.setFrustum(uboViewProjection.projection * uboViewProjection.view);
+
+	//Pack the world space sphere of every live instance, mesh by mesh
+	frustumCuller.clear();
+	for(Mesh& mesh : meshes)
+	{
+		glm::vec4 bounds = mesh.getBounds();
+		for(uint32_t i = 0; i < mesh.getInstanceCount(); i++)
+		{
+			const glm::mat4& model = instanceBuffer.read(mesh.getInstanceOffset() + i).model;
+			glm::vec3 centre = glm::vec3(model * glm::vec4(glm::vec3(bounds), 1.0f));
+			float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+			frustumCuller.addSphere(centre, bounds.w * scale);
+		}
+	}
+
+	frustumCuller.cull();
+
+	//Same order again: results to slot bits
+	std::vector<uint32_t> visibilityMask((instanceBuffer.getCapacity() + 31) / 32, 0);
+	size_t sphereIndex = 0;
+	for(Mesh& mesh : meshes)
+	{
+		for(uint32_t j = 0; j < mesh.getInstanceCount(); j++, sphereIndex++)
+		{
+			if(!frustumCuller.isVisible(sphereIndex)) continue;
+
+			uint32_t slot = mesh.getInstanceOffset() + j;
+			visibilityMask[slot / 32] |= 1u << (slot % 32);
+		}
+	}
+
+	//The direct draws bake which runs of instances are visible, only a change needs new recordings
+	if(visibilityMask != hostVisibilityMask)
+	{
+		hostVisibilityMask.swap(visibilityMask);
+		markCommandBuffersDirty();
+	}
+}
+
+bool VulkanRenderer::isHostVisible(uint32_t slot)
+{
+	return (hostVisibilityMask[slot / 32] & (1u << (slot % 32))) != 0;
+}
+
 //We just get the hardware GPU, so no creation of object and no need to destroy nothing about physical device
 void VulkanRenderer::getPhysicalDevice()
 {
@@ -1248,28 +2551,55 @@ void VulkanRenderer::getPhysicalDevice()
 	VkPhysicalDeviceProperties deviceProperties;
 	vkGetPhysicalDeviceProperties(mainDevice.physicalDevice, &deviceProperties);
 
-	// minUniformBufferOffset = deviceProperties.limits.minUniformBufferOffsetAlignment;
+	//Alignment of the dynamic offsets into the frame ring buffers
+	minUniformBufferOffset = deviceProperties.limits.minUniformBufferOffsetAlignment;
+	minStorageBufferOffset = deviceProperties.limits.minStorageBufferOffsetAlignment;
+
+	//The texture array is the only fragment stage resource besides the colour output, its samplers also count as
+	//sampled images (no update after bind, so the plain limits apply)
+	const VkPhysicalDeviceLimits& limits = deviceProperties.limits;
+	textureArraySize = std::min({ MAX_TEXTURES, limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages,
+		limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages, limits.maxPerStageResources - 1 });
 }
 
 std::vector<const char*> VulkanRenderer::getRequiredExtensions()
 {
 
-	//The extensions specified by GLFW are always required, but the debug messenger extension is conditionally added
-	//Set up extensions Instance will use
-	uint32_t glfwExtensionCount = 0;						//GLFW may require multiple extensions
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	//The extensions specified by GLFW are required to present, but the debug messenger extension is conditionally added
+	std::vector<const char*> extensions;
 
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	if(!headless)
+	{
+		//Set up extensions Instance will use
+		uint32_t glfwExtensionCount = 0;						//GLFW may require multiple extensions
+		const char** glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	}
 
 	if (enableValidationLayers) {
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-		extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+		if(!headless)
+		{
+			extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+		}
 	}
 
 	return extensions;
 }
 
+std::vector<const char*> VulkanRenderer::getRequiredDeviceExtensions()
+{
+	//Nothing is presented offscreen, so the swapchain extension is not needed
+	if(headless)
+	{
+		return {};
+	}
+
+	return deviceExtensions;
+}
+
 void VulkanRenderer::allocateDynamicBufferTransferSpace()
 {
 	//NOT IN USE ANYMORE (Model used not with UBOD, but with push_constant)
@@ -1282,6 +2612,42 @@ void VulkanRenderer::allocateDynamicBufferTransferSpace()
 	// modelTransferSpace = (Model *)_aligned_malloc(modelUniformAllignment * MAX_OBJECTS, modelUniformAllignment);
 }
 
+void VulkanRenderer::waitFramesIdle()
+{
+	timeline.waitIdle();
+
+	//A present is no timeline submit, it may still wait on a frame's renderFinished semaphore
+	if(!headless)
+	{
+		vkQueueWaitIdle(presentationQueue);
+	}
+}
+
+void VulkanRenderer::destroyFrameContexts()
+{
+	for(auto& frame : frames)
+	{
+		frame.destroy();
+	}
+	frames.clear();
+	gpuProfiler.destroy();
+}
+
+void VulkanRenderer::destroyOffscreenTargets()
+{
+	//Offscreen images are owned by the renderer
+	for(size_t i = 0; i < swapChainImages.size(); i++)
+	{
+		vkDestroyImageView(mainDevice.logicalDevice, swapChainImages[i].imageView, HostAllocator::getCallbacks());
+		vkDestroyImage(mainDevice.logicalDevice, swapChainImages[i].image, HostAllocator::getCallbacks());
+		deviceAllocator.free(offscreenImagesAllocation[i]);
+	}
+	swapChainImages.clear();
+	offscreenImagesAllocation.clear();
+
+	destroyBuffer(deviceAllocator, mainDevice.logicalDevice, readbackBuffer, &readbackBufferAllocation);
+}
+
 void VulkanRenderer::populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo)
 {
 	createInfo = {};
@@ -1320,25 +2686,42 @@ bool VulkanRenderer::checkInstanceExtensionsSupport(std::vector<const char*>* ch
 	return true;
 }
 
+bool VulkanRenderer::isDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName)
+{
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+
+	for (const auto& extension : extensions)
+	{
+		if (strcmp(extensionName, extension.extensionName) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 bool VulkanRenderer::checkDeviceExtensionsSupport(VkPhysicalDevice device)
 {
 	//Need to get the number of extensions to hold extensions
 	uint32_t extensionCount = 0;
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
 
-	if (extensionCount == 0)return false;
+	if (extensionCount == 0)return getRequiredDeviceExtensions().empty();
 
 	//Populate extensions
 	std::vector<VkExtensionProperties> extensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
 
 	//Check if given extensions are in the list of available extensions
-	for (const auto& deviceExtension : deviceExtensions)
+	for (const auto& deviceExtension : getRequiredDeviceExtensions())
 	{
 		bool hasExtensions = false;
 		for (const auto& extension : extensions)
 		{
-			if (strcmp(deviceExtension, extension.extensionName))
+			if (strcmp(deviceExtension, extension.extensionName) == 0)
 			{
 				hasExtensions = true;
 				break;
@@ -1359,20 +2742,32 @@ bool VulkanRenderer::checkDeviceSuitable(VkPhysicalDevice device)
 	//Information about what the device can do (geometry shader, tessellation shader, wide lines, etc)
 	VkPhysicalDeviceFeatures deviceFeatures;
 	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+
+	//Vulkan 1.2 features (needs a 1.2 device)
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 deviceFeatures2 = {};
+	deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	deviceFeatures2.pNext = &vulkan12Features;
+	vkGetPhysicalDeviceFeatures2(device, &deviceFeatures2);
 	
 
 	QueueFamilyIndices indices = getQueueFamiliesIndices(device);
 
 	bool extensionsSupported = checkDeviceExtensionsSupport(device);
 
-	bool swapChainValid = false;
-	if (extensionsSupported)
+	//Offscreen rendering doesn't need a swapchain
+	bool swapChainValid = headless;
+	if (extensionsSupported && !headless)
 	{
 		SwapChainDetails swapChainDetails = getSwapChainDetails(device);
 		swapChainValid = !swapChainDetails.formats.empty() && !swapChainDetails.presentationModes.empty();
 	}
 	
-	return indices.isValid() && extensionsSupported && swapChainValid && deviceFeatures.samplerAnisotropy;
+	return indices.isValid(!headless) && extensionsSupported && swapChainValid && deviceFeatures.samplerAnisotropy
+		&& vulkan12Features.timelineSemaphore && vulkan12Features.shaderSampledImageArrayNonUniformIndexing
+		&& vulkan12Features.descriptorBindingPartiallyBound && vulkan12Features.descriptorBindingUpdateUnusedWhilePending;
 }
 
 bool VulkanRenderer::checkValidationLayerSupport()
@@ -1414,29 +2809,40 @@ QueueFamilyIndices VulkanRenderer::getQueueFamiliesIndices(VkPhysicalDevice devi
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilyList.data());
 	
 	//Go through each queue family and check if it has at least 1 of the required types of queue
+	//Every family is looked at: the transfer only one is usually after the graphics one
 	int i=0;
 	for (const auto& queueFamily : queueFamilyList)
 	{
 		//First check if queue family has at least 1 queue in that family
+		if (queueFamily.queueCount == 0)
+		{
+			i++;
+			continue;
+		}
+
 		//Queue can be multiple types defined trough bitfield. Need to bitwise AND with VK_QUEUE_GRAPHICS_BIT
-		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)//& bitwise and
+		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT && indices.graphicsFamily < 0)//& bitwise and
 		{
 			indices.graphicsFamily = i;			//If queue family is valid, then get index
 		}
 
-		//Check if queue family support presentation
+		//Check if queue family support presentation (no surface to present to when headless)
 		VkBool32 presentationSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device,i,surface,&presentationSupport);
-		//Check if queue is presentation type (can be both graphics and presentation)
-		if (queueFamily.queueCount > 0 && presentationSupport)
+		if(!headless)
+		{
+			vkGetPhysicalDeviceSurfaceSupportKHR(device,i,surface,&presentationSupport);
+		}
+		//Check if queue is presentation type (can be both graphics and presentation, prefer that one)
+		if (presentationSupport && (indices.presentationFamily < 0 || i == indices.graphicsFamily))
 		{
 			indices.presentationFamily = i;			//If queue family is valid, then get index
 		}
 
-		//Check if queue family indices are in a valid state, stop searching it
-		if (indices.graphicsFamily)
+		//Transfer but neither graphics nor compute: a copy engine that runs next to the graphics queue
+		VkQueueFlags engineFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+		if (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT && !(queueFamily.queueFlags & engineFlags) && indices.transferFamily < 0)
 		{
-			break;
+			indices.transferFamily = i;
 		}
 		i++;
 	}
@@ -1506,15 +2912,19 @@ VkSurfaceFormatKHR VulkanRenderer::chooseBestSurfaceFormat(const std::vector<VkS
 
 VkPresentModeKHR VulkanRenderer::chooseBestPresentationMode(const std::vector<VkPresentModeKHR>& presentationModes)
 {
-	for(const auto &presentationMode : presentationModes)
+	//Lowest latency: immediate (may tear), else mailbox (newest frame replaces the queued one)
+	if(framePacer.getPolicy() == PresentPolicy::LowLatency)
 	{
-		//We want mailbox
-		if(presentationMode == VK_PRESENT_MODE_MAILBOX_KHR)
+		for(VkPresentModeKHR wanted : {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR})
 		{
-			return presentationMode;
+			if(std::find(presentationModes.begin(), presentationModes.end(), wanted) != presentationModes.end())
+			{
+				return wanted;
+			}
 		}
 	}
 
+	//Power saving and strict FIFO both present once per vblank, the pacer caps the rate
 	//This always has to be available
 	return VK_PRESENT_MODE_FIFO_KHR;
 }
@@ -1571,8 +2981,36 @@ VkFormat VulkanRenderer::chooseSupportedFormat(const std::vector<VkFormat>& form
 	throw std::runtime_error("Failed to find a matching format!");
 }
 
+VkFormat VulkanRenderer::chooseDepthFormat(uint32_t minDepthBits, VkFormatFeatureFlags featureFlags)
+{
+	//Smallest first, stencil formats last: stencil is never used, and can cost its own plane per pixel
+	struct DepthFormat {
+		VkFormat format;
+		uint32_t depthBits;
+	};
+	const DepthFormat depthFormats[] = {
+		{VK_FORMAT_D16_UNORM, 16},
+		{VK_FORMAT_X8_D24_UNORM_PACK32, 24},
+		{VK_FORMAT_D32_SFLOAT, 32},
+		{VK_FORMAT_D24_UNORM_S8_UINT, 24},
+		{VK_FORMAT_D32_SFLOAT_S8_UINT, 32}
+	};
+
+	std::vector<VkFormat> formats;
+	for(const DepthFormat& depthFormat : depthFormats)
+	{
+		if(depthFormat.depthBits >= minDepthBits)
+		{
+			formats.push_back(depthFormat.format);
+		}
+	}
+
+	return chooseSupportedFormat(formats, VK_IMAGE_TILING_OPTIMAL, featureFlags);
+}
+
 VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
-                                    VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, VkDeviceMemory* imageMemory)
+                                    VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, DeviceAllocation* imageAllocation,
+                                    DeviceMemoryCategory category)
 {
 	//CREATE IMAGE
 	//Image Creation Info
@@ -1593,35 +3031,16 @@ VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat fo
 
 	//Create an image
 	VkImage image;
-	VkResult result = vkCreateImage(mainDevice.logicalDevice, &imageCreateInfo, nullptr, &image);
+	VkResult result = vkCreateImage(mainDevice.logicalDevice, &imageCreateInfo, HostAllocator::getCallbacks(), &image);
 	if(result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create an Image!");
 	}
 	
 	//CREATE MEMORY FOR IMAGE
-	//Get memory requirements for a type of image
-	VkMemoryRequirements memoryRequirements;
-	vkGetImageMemoryRequirements(mainDevice.logicalDevice, image, &memoryRequirements);
-
-	//Allocate memory for an image using requirements and user defined props
-	VkMemoryAllocateInfo memoryAllocInfo = {};
-	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocInfo.allocationSize = memoryRequirements.size;
-	memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(mainDevice.physicalDevice, memoryRequirements.memoryTypeBits, propFlags);
-
-	result = vkAllocateMemory(mainDevice.logicalDevice, &memoryAllocInfo, nullptr, imageMemory);
-	if(result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate memory for an Image!");
-	}
-
-	//Connect memory to image
-	result = vkBindImageMemory(mainDevice.logicalDevice, image, *imageMemory, 0);
-	if(result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to bind memory to an Image!");
-	}
+	//Sub-allocate memory using the image requirements and user defined props, and connect it to the image
+	//(render targets and big textures get a dedicated allocation)
+	*imageAllocation = deviceAllocator.allocateImageMemory(image, propFlags, category);
 
 	return image;
 }
@@ -1647,7 +3066,7 @@ VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkIm
 
 	//Create image view and return it
 	VkImageView imageView;
-	VkResult result = vkCreateImageView(mainDevice.logicalDevice, &viewCreateInfo, /*Memory management TODO*/nullptr, &imageView);
+	VkResult result = vkCreateImageView(mainDevice.logicalDevice, &viewCreateInfo, HostAllocator::getCallbacks(), &imageView);
 
 	if(result != VK_SUCCESS)
 	{
@@ -1666,7 +3085,7 @@ VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char>& code)
 	shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());		//Pointer to code (of uint32_t pointer type)
 
 	VkShaderModule shaderModule;
-	VkResult result = vkCreateShaderModule(mainDevice.logicalDevice, &shaderModuleCreateInfo, /*Memory management TODO*/nullptr, &shaderModule);
+	VkResult result = vkCreateShaderModule(mainDevice.logicalDevice, &shaderModuleCreateInfo, HostAllocator::getCallbacks(), &shaderModule);
 
 	if(result != VK_SUCCESS)
 	{
@@ -1676,94 +3095,46 @@ VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char>& code)
 	return shaderModule;
 }
 
-int VulkanRenderer::createTextureImage(std::string fileName)
+VkImage VulkanRenderer::createTextureImage(std::string fileName, DeviceAllocation* imageAllocation)
 {
 	//Load image file
 	int width, height;
 	VkDeviceSize imageSize;
 	stbi_uc* imageData = loadTextureFile(fileName, &width, &height, &imageSize);
 
-	//Create staging buffer to hold loaded data, ready to copy to device
-	VkBuffer imageStagingBuffer;
-	VkDeviceMemory imageStagingBufferMemory;
-	createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&imageStagingBuffer, &imageStagingBufferMemory);
-
-	//Copy image data to staging buffer
-	void* data;
-	vkMapMemory(mainDevice.logicalDevice, imageStagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, imageData, static_cast<size_t>(imageSize));
-	vkUnmapMemory(mainDevice.logicalDevice, imageStagingBufferMemory);
-
-	//Free original image data
-	stbi_image_free(imageData);
-
 	//Create image to hold final texture
 	VkImage texImage;
-	VkDeviceMemory texImageMemory;
 	texImage = createImage(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
 		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		&texImageMemory);
+		imageAllocation, MEMORY_CATEGORY_TEXTURES);
 
 	//COPY DATA TO IMAGE
-	//Transition image to dst for copy operation
-	transitionImageLayout(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool, texImage,
-		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	
-	//Copy image data
-	copyImageBuffer(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool,
-		imageStagingBuffer, texImage, width, height);
-
-	//Transition image to be shader readable for shader usage
-	transitionImageLayout(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool, texImage,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	
-
-	//Add texture data to vector for reference
-	textureImages.push_back(texImage);
-	textureImagesMemory.push_back(texImageMemory);
-
-	//Destroy staging buffer
-	vkDestroyBuffer(mainDevice.logicalDevice, imageStagingBuffer, nullptr);
-	vkFreeMemory(mainDevice.logicalDevice, imageStagingBufferMemory, nullptr);
-
-	//Return index of new texture
-	return textureImages.size() - 1; 
-}
+	//Staged into the upload ring right away (so the file data can go), transitions + copy run with the next batch
+	//and leave the image shader readable
+	uploadManager.uploadImage(texImage, width, height, imageData, imageSize);
 
-int VulkanRenderer::createTexture(std::string fileName)
-{
-	//Create texture image and get its location in array
-	int textureImageLoc = createTextureImage(fileName);
-
-	//Create Image View and add to list
-	VkImageView imageView = createImageView(textureImages[textureImageLoc], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
-	textureImageViews.push_back(imageView);
-
-	//Create Texture descriptor
-	int descriptorLoc = createTextureDescriptor(imageView);
+	//Free original image data
+	stbi_image_free(imageData);
 
-	//Return location of set with texture
-	return descriptorLoc;
+	return texImage;
 }
 
-int VulkanRenderer::createTextureDescriptor(VkImageView textureImage)
+uint32_t VulkanRenderer::createTextureDescriptor(VkImageView textureImage)
 {
-	VkDescriptorSet descriptorSet;
-
-	//Descriptor Set Allocation info
-	VkDescriptorSetAllocateInfo setAllocInfo = {};
-	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	setAllocInfo.descriptorPool = samplerDescriptorPool;
-	setAllocInfo.descriptorSetCount = 1;
-	setAllocInfo.pSetLayouts = &samplerSetLayout;
-
-	//Allocate descriptor set
-	VkResult result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &setAllocInfo, &descriptorSet);
-	if(result != VK_SUCCESS)
+	//Element of the texture array: a freed one (its frames are done with it), else the next unused one
+	uint32_t descriptorIndex;
+	if(!freeTextureDescriptors.empty())
 	{
-		throw std::runtime_error("Failed to allocate Texture Descriptor Set!");
+		descriptorIndex = freeTextureDescriptors.back();
+		freeTextureDescriptors.pop_back();
+	}
+	else if(textureDescriptorCount < textureArraySize)
+	{
+		descriptorIndex = textureDescriptorCount++;
+	}
+	else
+	{
+		throw std::runtime_error("Texture array full!");
 	}
 
 	//Texture image info
@@ -1775,25 +3146,23 @@ int VulkanRenderer::createTextureDescriptor(VkImageView textureImage)
 	//Descriptor Write Info
 	VkWriteDescriptorSet descriptorWrite = {};
 	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrite.dstSet = descriptorSet;
+	descriptorWrite.dstSet = textureDescriptorSet;
 	descriptorWrite.dstBinding = 0;
-	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.dstArrayElement = descriptorIndex;
 	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	descriptorWrite.descriptorCount = 1;
 	descriptorWrite.pImageInfo = &imageInfo;
 
-	//Update new descriptor set
+	//Update the element (UPDATE_UNUSED_WHILE_PENDING: fine while frames use the other ones)
 	vkUpdateDescriptorSets(mainDevice.logicalDevice, 1, &descriptorWrite, 0, nullptr);
 
-	//Add descriptor set to list
-	samplerDescriptorSets.push_back(descriptorSet);
-
-	//Return descriptor set location
-	return samplerDescriptorSets.size() -1;
+	return descriptorIndex;
 }
 
 stbi_uc* VulkanRenderer::loadTextureFile(std::string fileName, int* width, int* height, VkDeviceSize* imageSize)
 {
+	TRACE_SCOPE("loadTextureFile");
+
 	//Number of channels image uses
 	int channels;
 
@@ -1812,6 +3181,12 @@ stbi_uc* VulkanRenderer::loadTextureFile(std::string fileName, int* width, int*
 	return image;
 }
 
+void VulkanRenderer::framebufferResizeCallback(GLFWwindow* window, int width, int height)
+{
+	auto renderer = reinterpret_cast<VulkanRenderer*>(glfwGetWindowUserPointer(window));
+	renderer->framebufferResized = true;
+}
+
 VKAPI_ATTR VkBool32 VKAPI_CALL VulkanRenderer::debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData)
 {
 	switch(messageSeverity)
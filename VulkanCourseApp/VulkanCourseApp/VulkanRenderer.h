@@ -12,11 +12,25 @@
 #include <set>
 #include <algorithm>
 #include <array>
+#include <chrono>
 
 #include "stb_image.h"
 
 #include "Mesh.h"
+#include "FrameContext.h"
+#include "TimelineScheduler.h"
+#include "FramePacer.h"
+#include "GpuProfiler.h"
+#include "Tracer.h"
 #include "Utilities.h"
+#include "WorkerPool.h"
+#include "UploadManager.h"
+#include "DeletionQueue.h"
+#include "AttachmentPool.h"
+#include "InstanceBuffer.h"
+#include "CullingPass.h"
+#include "FrustumCuller.h"
+#include "DepthPyramid.h"
 
 class VulkanRenderer
 {
@@ -24,9 +38,92 @@ public:
 	VulkanRenderer();
 
 	int init(GLFWwindow* newWindow);
-
-	void updateModel(int modelId, glm::mat4 newModel);
+	//Render into renderer owned images instead of a window swapchain (no surface, no presentation)
+	int initHeadless(uint32_t width, uint32_t height);
+
+	//Copy last rendered frame back to host as tightly packed RGBA8 (size of getFrameExtent())
+	std::vector<uint8_t> readFrame();
+	VkExtent2D getFrameExtent();
+
+	//Transform of the mesh's own instance (the one it was created with)
+	//false when the mesh or that instance was removed, the remaining instances are moved with updateInstance
+	bool updateModel(MeshHandle mesh, glm::mat4 newModel);
+
+	//Instancing: another copy of the mesh, every instance of a mesh is drawn by the same instanced draw
+	InstanceHandle addInstance(MeshHandle mesh, glm::mat4 transform, TextureHandle texture);
+	//O(1) writes into the instance buffer, recorded commands stay valid
+	void updateInstance(InstanceHandle instance, glm::mat4 transform);
+	void setInstanceTexture(InstanceHandle instance, TextureHandle texture);
+	void removeInstance(InstanceHandle instance);
+	size_t getInstanceCount();
+
+	//Streaming: the mesh gets its handle right away but is only drawn once its upload completed, nothing waits for it
+	UploadTicket addMesh(std::vector<Vertex>* vertices, std::vector<uint32_t>* indices, TextureHandle texture,
+		MeshHandle* mesh = nullptr);
+	//Gone from the next frame on, its geometry is freed once the frames already submitted are done (no stall)
+	//Its handle goes stale, every other handle stays valid
+	void removeMesh(MeshHandle mesh);
+	//Texture + its descriptor set, uploaded with the next batch
+	TextureHandle createTexture(std::string fileName);
+	//Same as removeMesh for a texture, throws while an instance still uses it (remove or retexture those first)
+	void removeTexture(TextureHandle texture);
+	size_t getMeshCount();
+	//Handle of a live mesh by position (0..getMeshCount()-1, positions change when meshes are removed)
+	MeshHandle getMeshHandle(size_t meshIndex);
+
+	//Reuse recorded command buffers until something structural changes (meshes, pipeline, descriptors)
+	void setCommandBufferCaching(bool enabled);
+	void markCommandBuffersDirty();
+
+	//Frames the CPU may run ahead of the GPU (1..MAX_FRAMES_IN_FLIGHT): fewer = less latency, more = more throughput
+	//Can be called before init or at runtime
+	void setFramesInFlight(uint32_t frameCount);
+	uint32_t getFramesInFlight();
+
+	//Indirect draws: one vkCmdDrawIndexedIndirect for every mesh, reading draw commands written to the frame ring each frame
+	//(recording no longer grows with the mesh count). Only used when the device supports multi draw indirect
+	void setIndirectDrawing(bool enabled);
+	bool isIndirectDrawing();
+
+	//Frustum culling in a compute pass, meshes drawn with vkCmdDrawIndexedIndirectCount from what survived
+	//(no per instance CPU work). Needs indirect drawing and drawIndirectCount, else every instance is drawn
+	void setGpuCulling(bool enabled);
+	bool isGpuCulling();
+	//Fallback when not culling on the GPU: every instance sphere tested on the CPU (SIMD) before drawing,
+	//meshes are drawn directly with one draw per run of visible instances (no compute pass, no indirect features)
+	void setCpuCulling(bool enabled);
+	bool isCpuCulling();
+	//Visible/culled instances of the last CPU cull (nothing when culling on the GPU: its results stay there)
+	CullStats getCullStats();
+	//Hierarchical-Z occlusion culling on top of GPU culling: what last frame's depth pyramid hides is skipped by the main
+	//pass, tested again once its depth is rendered and drawn in a second pass if it turned visible
+	//Off by default: it needs the depth attachment stored and sampled, so the depth can no longer be transient and lazily
+	//allocated (tile memory only on tilers), a full size depth image in VRAM plus its store bandwidth every frame instead
+	//Only takes effect when enabled before init, enabling it later does nothing then
+	void setOcclusionCulling(bool enabled);
+	bool isOcclusionCulling();
+
+	//Number of threads recording draw commands (1 = main thread only)
+	void setRecordThreadCount(uint32_t threadCount);
+	//Time recordCommands for 1..maxThreads recording threads over objectCount objects and print the speedup
+	//(direct draws for the run: indirect drawing records a single call on one thread)
+	void benchmarkRecording(uint32_t maxThreads, uint32_t objectCount, uint32_t iterations);
+	//Time buffer uploads through staging + GPU copy against direct writes to host visible VRAM, for a few sizes
+	void benchmarkUploads(uint32_t iterations);
 	
+	//Present mode + frame pacing (targetFps only used by PowerSaving), recreates the swapchain if needed
+	void setPresentPolicy(PresentPolicy policy, double targetFps = 30.0);
+	//Call before sampling input: waits for a free frame and sleeps so the frame starts as late as possible
+	void waitForNextFrame();
+	FrameTiming getLastFrameTiming();
+	FrameTimingStats getFrameTimingStats();
+	//GPU time of the profiled scopes (render pass, uploads, readback) since the renderer started
+	std::vector<GpuScopeStats> getGpuTimings();
+	//Device memory usage per heap, and number of live vkAllocateMemory allocations
+	//Per heap: our usage by category, and the budget/usage of the whole process (refreshed every frame)
+	std::vector<DeviceHeapStats> getMemoryStats();
+	uint32_t getDeviceMemoryCount();
+
 	void draw();
 	void cleanup();
 
@@ -34,11 +131,19 @@ public:
 
 private:
 	GLFWwindow* window;
+	bool headless = false;
 
-	int currentFrame = 0;
+	uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+	uint32_t currentFrame = 0;
+	uint32_t lastFrame = 0;
+	uint32_t lastImageIndex = 0;
 
 	//Scene Objects
-	std::vector<Mesh> meshList;
+	HandleTable<Mesh> meshes;					//Dense: drawn in table order, one instanced draw each
+	HandleTable<Instance> instances;
+	InstanceBuffer instanceBuffer;				//Transform + texture of every instance, one buffer per frame in flight
+	CullingPass cullingPass;					//Visible list and draws of every frame when culling on the GPU
+	GeometryPool geometryPool;					//Vertex/index data of every mesh
 
 	//Scene settings
 	struct UboViewProjection {
@@ -53,18 +158,57 @@ private:
 		VkPhysicalDevice physicalDevice;
 		VkDevice logicalDevice;
 	} mainDevice;
+	DeviceAllocator deviceAllocator;			//Every buffer/image memory comes from here
 	VkQueue graphicsQueue;
 	VkQueue presentationQueue;
+	VkQueue transferQueue;						//Same as graphicsQueue when the device has no transfer only family
+	uint32_t transferQueueFamily;
 	VkSurfaceKHR surface;
-	VkSwapchainKHR swapChain;
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+	bool framebufferResized = false;				//Set by the GLFW resize callback, handled at the next draw
 	
 	std::vector<SwapChainImage> swapChainImages;
 	std::vector<VkFramebuffer> swapChainFrameBuffers;
-	std::vector<VkCommandBuffer> commandBuffers;
 
-	VkImage depthBufferImage;
-	VkDeviceMemory depthBufferImageMemory;
-	VkImageView depthBufferImageView;
+	//-Replaced or removed resources (old swapchains, meshes, textures), destroyed once the timeline passes
+	//the last frame that could use them
+	DeletionQueue deletionQueue;
+
+	//-Frames in flight (command buffers, frame data, descriptor set and semaphores of each frame)
+	std::vector<FrameContext> frames;
+	TimelineScheduler timeline;					//GPU progress of every submit, frames wait on it before reuse
+	FramePacer framePacer;
+	GpuProfiler gpuProfiler;
+	bool hostQueryResetSupported = false;
+	bool memoryBudgetSupported = false;
+	bool cacheCommandBuffers = true;
+	bool indirectDrawSupported = false;
+	bool indirectDrawing = true;
+	bool drawIndirectCountSupported = false;
+	bool gpuCulling = true;
+	bool cpuCulling = true;
+	bool occlusionCullingSupported = false;
+	bool occlusionCulling = false;
+	bool hasDepthPyramid = false;				//Decided with the render pass: depth kept and sampled, pyramid built
+	DepthPyramid depthPyramid;					//Its image and sets are recreated with the swapchain
+	bool pyramidHistoryValid = false;			//It holds the last frame's depth (not after a resize or a frame without it)
+	glm::mat4 pyramidViewProjection;			//What that depth was rendered with
+	FrustumCuller frustumCuller;
+	std::vector<uint32_t> hostVisibilityMask;		//Bit per instance slot, from the last CPU cull
+
+	//-Recording workers (each frame context has a command pool per worker)
+	WorkerPool recordWorkerPool;
+	uint32_t recordThreadCount = 1;
+
+	//-Offscreen (headless only, images replace the swapchain ones)
+	std::vector<DeviceAllocation> offscreenImagesAllocation;
+	VkBuffer readbackBuffer;
+	DeviceAllocation readbackBufferAllocation;
+
+	//-Size dependent attachments (depth, and its pyramid), recreated with the swapchain
+	AttachmentPool renderTargets;
+	uint32_t depthTarget = 0;
+	VkFormat depthFormat;
 	
 	VkSampler textureSampler;
 
@@ -72,45 +216,42 @@ private:
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorSetLayout samplerSetLayout;
 
-	VkPushConstantRange pushConstantRange;
-
 	VkDescriptorPool descriptorPool;
 	VkDescriptorPool samplerDescriptorPool;
-	std::vector<VkDescriptorSet> descriptorSets;
-	std::vector<VkDescriptorSet> samplerDescriptorSets;
-
-	std::vector<VkBuffer> vpUniformBuffer;
-	std::vector<VkDeviceMemory> vpUniformBufferMemory;
+	VkDescriptorSet textureDescriptorSet;		//Bindless: every texture is an element of one array, bound once per draw range
+	uint32_t textureDescriptorCount = 0;		//Elements handed out so far
+	uint32_t textureArraySize = MAX_TEXTURES;	//Array length: MAX_TEXTURES clamped to the device limits (spec constant of shader.frag)
+	std::vector<uint32_t> freeTextureDescriptors;
 
 	std::vector<VkBuffer> modelDynamicUniformBuffer;
 	std::vector<VkDeviceMemory> modelDynamicUniformBufferMemory;
 	
-	// VkDeviceSize minUniformBufferOffset;
+	VkDeviceSize minUniformBufferOffset;
+	VkDeviceSize minStorageBufferOffset;
 	// size_t modelUniformAllignment;
 	// Model* modelTransferSpace;
 
 	//-Assets
-	std::vector<VkImage> textureImages;
-	std::vector<VkDeviceMemory> textureImagesMemory;
-	std::vector<VkImageView> textureImageViews;
+	HandleTable<Texture> textures;
 
 	//-Pipeline
 	VkPipeline graphicsPipeline;
 	VkPipelineLayout pipelineLayout;
 	VkRenderPass renderPass;
+	//Occlusion culling: the main pass keeps depth for the pyramid, the second one loads both attachments and draws
+	//what became visible (all three are compatible: same framebuffers, pipeline and secondary buffers)
+	std::array<VkRenderPass, 2> occlusionRenderPasses;
 
 	//-Pools
 	VkCommandPool graphicsCommandPool;
 
+	//-Staging copies (batched, one submit per flush)
+	UploadManager uploadManager;
+
 	//-Utils
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
 
-	//-Syncronization
-	std::vector<VkSemaphore> imageAvailable;
-	std::vector<VkSemaphore> renderFinished;
-	std::vector<VkFence> drawFences;
-
 	//-Validation layer
 	const std::vector<const char*> validationLayers = {
 		"VK_LAYER_KHRONOS_validation"
@@ -126,39 +267,61 @@ private:
 
 
 	//Vulkan Functions
+	int initRenderer();
+
 	//-Create Functions
 	void createInstance();
 	void createLogicalDevice();
 	void createDebugMessenger();
 	void createSurface();
 	void createSwapChain();
+	void recreateSwapChain();
+	void createOffscreenTargets();
 	void createRenderPass();
+	void createOcclusionRenderPasses();
 	void createDescriptorSetLayout();
-	void createPushConstantRange();
 	void createGraphicsPipeline();
-	void createDepthBufferImage();
+	void createRenderTargets();
 	void createFrameBuffers();
 	void createCommandPool();
-	void createCommandBuffers();
-	void createSynchronization();
+	void createFrameContexts();
 	void createTextureSampler();
 
-	void createUniformBuffers();
 	void createDescriptorPool();
 	void createDescriptorSets();
+	void createTextureDescriptorSet();
 
-	void updateUniformBuffers(uint32_t imageIndex);
+	void updateProjection();
+	void updateUniformBuffers(uint32_t frameIndex);
 
 	//-Record Functions
-	void recordCommands(uint32_t currentImage);
+	void recordCommands(uint32_t frameIndex, uint32_t imageIndex);
+	void recordDrawCommands(uint32_t frameIndex);
+	void recordMeshRange(uint32_t workerIndex, uint32_t frameIndex, size_t firstMesh, size_t lastMesh);
+	//Pipeline, dynamic state, geometry and descriptor sets every draw of the frame uses
+	void recordDrawState(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	//Indirect draw command of every mesh into the frame ring (instanceCount 0 for meshes not drawn)
+	void writeDrawCommands(uint32_t frameIndex);
+	//Frustum + per mesh data of the culling pass (indexed by mesh handle index)
+	void writeCullData(uint32_t frameIndex);
+	//Test every live instance on the CPU, fills hostVisibilityMask (recordings are dirty when it changed)
+	void cullOnHost();
+	bool isHostVisible(uint32_t slot);
 
 	//-Get Functions
 	void getPhysicalDevice();
 	//Return the required list of extensions based on whether validation layers are enabled or not
 	std::vector<const char*> getRequiredExtensions();
+	std::vector<const char*> getRequiredDeviceExtensions();
 
 	//--Allocate Functions
 	void allocateDynamicBufferTransferSpace();
+
+	//--Destroy Functions
+	//Before tearing down per-frame state: the timeline covers submits, not the presents waiting on renderFinished
+	void waitFramesIdle();
+	void destroyFrameContexts();
+	void destroyOffscreenTargets();
 	
 	//-Support Functions
 	void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
@@ -166,6 +329,7 @@ private:
 	//--Checker Functions
 	bool checkInstanceExtensionsSupport(std::vector<const char*>* checkExtensions);
 	bool checkDeviceExtensionsSupport(VkPhysicalDevice device);
+	bool isDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName);
 	bool checkDeviceSuitable(VkPhysicalDevice device);
 	bool checkValidationLayerSupport();
 
@@ -178,22 +342,35 @@ private:
 	VkPresentModeKHR chooseBestPresentationMode(const std::vector<VkPresentModeKHR> &presentationModes);
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &surfaceCapabilities);
 	VkFormat chooseSupportedFormat(const std::vector<VkFormat> &formats, VkImageTiling tiling, VkFormatFeatureFlags featureFlags);
+	VkFormat chooseDepthFormat(uint32_t minDepthBits, VkFormatFeatureFlags featureFlags);
 
 	//--Create functions
 	VkImage createImage(uint32_t width, uint32_t height, VkFormat format,
 		VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags,
-		VkDeviceMemory* imageMemory);
+		DeviceAllocation* imageAllocation, DeviceMemoryCategory category);
 	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
 	VkShaderModule createShaderModule(const std::vector<char> &code);
 
-	int createTextureImage(std::string fileName);
-	int createTexture(std::string fileName);
-	int createTextureDescriptor(VkImageView textureImage);
+	VkImage createTextureImage(std::string fileName, DeviceAllocation* imageAllocation);
+	uint32_t createTextureDescriptor(VkImageView textureImage);
+
+	//--Instance Functions
+	//Insert the mesh with its own instance
+	MeshHandle insertMesh(const Mesh& mesh);
+	//Move the mesh's instances to a range twice as big
+	void growInstanceRange(Mesh& mesh);
+	uint32_t getTextureIndex(TextureHandle texture);
+	//Instance references to a texture, which keep it from being removed
+	void acquireTexture(TextureHandle texture);
+	void releaseTexture(TextureHandle texture);
 
 	//--Loader Functions
 	stbi_uc* loadTextureFile(std::string fileName, int* width, int* height, VkDeviceSize* imageSize);
 	
 	//Static functions
+	//-Window Callback
+	static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
+
 	//-Debug Callback
 	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 		VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -0,0 +1,120 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool()
+{
+}
+
+void WorkerPool::start(uint32_t newWorkerCount)
+{
+	stop();
+
+	workerCount = newWorkerCount > 0 ? newWorkerCount : 1;
+	stopping = false;
+
+	//Worker 0 is the thread calling execute
+	for(uint32_t i = 1; i < workerCount; i++)
+	{
+		threads.emplace_back(&WorkerPool::workerLoop, this, i);
+	}
+}
+
+void WorkerPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobReady.notify_all();
+
+	for(auto& thread : threads)
+	{
+		thread.join();
+	}
+	threads.clear();
+	workerCount = 1;
+	jobGeneration = 0;
+}
+
+uint32_t WorkerPool::getWorkerCount()
+{
+	return workerCount;
+}
+
+void WorkerPool::execute(const std::function<void(uint32_t)>& job)
+{
+	//Hand the job to the background workers
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		currentJob = &job;
+		pendingWorkers = workerCount - 1;
+		jobError = nullptr;
+		jobGeneration++;
+	}
+	jobReady.notify_all();
+
+	//Do our share
+	std::exception_ptr localError;
+	try {
+		job(0);
+	}
+	catch (...) {
+		localError = std::current_exception();
+	}
+
+	//Wait for everybody else
+	std::unique_lock<std::mutex> lock(mutex);
+	jobDone.wait(lock, [this] { return pendingWorkers == 0; });
+	currentJob = nullptr;
+
+	if(localError)
+	{
+		std::rethrow_exception(localError);
+	}
+	if(jobError)
+	{
+		std::rethrow_exception(jobError);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+void WorkerPool::workerLoop(uint32_t workerIndex)
+{
+	uint64_t lastGeneration = 0;
+
+	while(true)
+	{
+		const std::function<void(uint32_t)>* job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobReady.wait(lock, [&] { return stopping || jobGeneration != lastGeneration; });
+			if(stopping)
+			{
+				return;
+			}
+			lastGeneration = jobGeneration;
+			job = currentJob;
+		}
+
+		std::exception_ptr error;
+		try {
+			(*job)(workerIndex);
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(error && !jobError)
+			{
+				jobError = error;
+			}
+			pendingWorkers--;
+		}
+		jobDone.notify_one();
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+//Fixed set of threads that all run the same job, each with its own worker index
+//The calling thread always takes worker 0, so a pool of 1 worker spawns no threads
+class WorkerPool
+{
+public:
+	WorkerPool();
+
+	void start(uint32_t newWorkerCount);
+	void stop();
+
+	uint32_t getWorkerCount();
+
+	//Run job(workerIndex) once on every worker and block until all of them finished
+	//An exception thrown by any worker is rethrown here
+	void execute(const std::function<void(uint32_t)>& job);
+
+	~WorkerPool();
+
+private:
+	uint32_t workerCount = 1;
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable jobReady;
+	std::condition_variable jobDone;
+
+	const std::function<void(uint32_t)>* currentJob = nullptr;
+	uint64_t jobGeneration = 0;			//Increases for every execute, wakes up the workers
+	uint32_t pendingWorkers = 0;		//Background workers still running current job
+	std::exception_ptr jobError;
+	bool stopping = false;
+
+	void workerLoop(uint32_t workerIndex);
+};
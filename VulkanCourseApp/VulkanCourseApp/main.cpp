@@ -7,6 +7,8 @@
 #include <stdexcept>
 #include <vector>
 #include <iostream>
+#include <string>
+#include <chrono>
 
 #include "VulkanRenderer.h"
 
@@ -21,14 +23,276 @@ void initWindow(std::string wName = "Test Window", const int width = 800, const
 
 	//Set GLFW to NOT work with OpenGL
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	//In Vulkan is complicate to handle the resizing of a window
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	//Resizing recreates the swapchain in the renderer
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 	window = glfwCreateWindow(width, height, wName.c_str(), nullptr, nullptr);
 }
 
-int main() 
+//Write the CPU trace collected since the last dump (nothing is collected without ENABLE_TRACING)
+void dumpTrace(const std::string& fileName)
 {
+	if(!Tracer::isEnabled()) return;
+
+	size_t eventCount = Tracer::dump(fileName);
+	std::cout << "Wrote " << eventCount << " trace events to " << fileName << std::endl;
+}
+
+//Print device memory usage of every heap the allocator touched
+void reportMemoryStats()
+{
+	std::vector<DeviceHeapStats> heapStats = vulkanRenderer.getMemoryStats();
+	std::cout << "Device memory allocations: " << vulkanRenderer.getDeviceMemoryCount() << std::endl;
+	for(size_t i = 0; i < heapStats.size(); i++)
+	{
+		const DeviceHeapStats& stats = heapStats[i];
+		if(stats.blockCount == 0 && stats.dedicatedCount == 0) continue;
+
+		std::cout << "  Heap " << i << " (" << stats.heapSize / (1024 * 1024) << " MB): "
+			<< stats.allocationCount << " allocations, " << stats.usedBytes / 1024 << " KB used of "
+			<< stats.blockCount << " blocks (" << stats.blockBytes / 1024 << " KB), "
+			<< stats.dedicatedCount << " dedicated (" << stats.dedicatedBytes / 1024 << " KB)" << std::endl;
+		std::cout << "    Budget: " << stats.usage / (1024 * 1024) << " / " << stats.budget / (1024 * 1024) << " MB used by the process";
+		for(uint32_t category = 0; category < MEMORY_CATEGORY_COUNT; category++)
+		{
+			if(stats.categoryBytes[category] == 0) continue;
+			std::cout << ", " << DeviceAllocator::getCategoryName(static_cast<DeviceMemoryCategory>(category)) << " "
+				<< stats.categoryBytes[category] / 1024 << " KB";
+		}
+		std::cout << std::endl;
+	}
+
+	//Host memory the driver asked us for, per allocation scope
+	std::cout << "Host memory pools: " << HostAllocator::getPooledBytes() / 1024 << " KB" << std::endl;
+	for(uint32_t scope = 0; scope < HostAllocator::SCOPE_COUNT; scope++)
+	{
+		HostScopeStats stats = HostAllocator::getStats(static_cast<VkSystemAllocationScope>(scope));
+		std::cout << "  " << HostAllocator::getScopeName(static_cast<VkSystemAllocationScope>(scope)) << ": "
+			<< stats.liveAllocations << " live (" << stats.liveBytes / 1024 << " KB, peak " << stats.peakBytes / 1024 << " KB), "
+			<< stats.totalAllocations << " total, " << stats.internalBytes / 1024 << " KB driver internal" << std::endl;
+	}
+}
+
+//Keys 1-4 change the frames in flight depth at runtime, T dumps the CPU trace, M prints memory usage,
+//C switches between GPU and CPU culling, V prints what the CPU culler kept,
+//O switches occlusion culling (only when started with --occlusion-culling)
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	if(action == GLFW_PRESS && key >= GLFW_KEY_1 && key <= GLFW_KEY_4)
+	{
+		vulkanRenderer.setFramesInFlight(key - GLFW_KEY_1 + 1);
+		std::cout << "Frames in flight: " << vulkanRenderer.getFramesInFlight() << std::endl;
+	}
+	if(action == GLFW_PRESS && key == GLFW_KEY_T)
+	{
+		dumpTrace("trace.json");
+	}
+	if(action == GLFW_PRESS && key == GLFW_KEY_M)
+	{
+		reportMemoryStats();
+	}
+	if(action == GLFW_PRESS && key == GLFW_KEY_C)
+	{
+		vulkanRenderer.setGpuCulling(!vulkanRenderer.isGpuCulling());
+		std::cout << "Culling: " << (vulkanRenderer.isGpuCulling() ? "GPU" : (vulkanRenderer.isCpuCulling() ? "CPU" : "off")) << std::endl;
+	}
+	if(action == GLFW_PRESS && key == GLFW_KEY_V)
+	{
+		CullStats stats = vulkanRenderer.getCullStats();
+		std::cout << "CPU culling: " << stats.visibleCount << " visible, " << stats.culledCount << " culled" << std::endl;
+	}
+	if(action == GLFW_PRESS && key == GLFW_KEY_O)
+	{
+		vulkanRenderer.setOcclusionCulling(!vulkanRenderer.isOcclusionCulling());
+		std::cout << "Occlusion culling: " << (vulkanRenderer.isOcclusionCulling() ? "on" : "off") << std::endl;
+	}
+}
+
+void updateScene(float deltaTime, float* angle)
+{
+	TRACE_SCOPE("updateScene");
+
+	*angle += 10.0f * deltaTime;
+	if(*angle > 360.0f)
+	{
+		*angle -= 360.0f;
+	}
+
+	glm::mat4 firstModel(1.0f);
+	glm::mat4 secondModel(1.0f);
+
+	firstModel = glm::translate(firstModel, glm::vec3(-1.0f, 0.0f, -2.5f));
+	firstModel = glm::rotate(firstModel, glm::radians(*angle), glm::vec3(0.0f, 0.0f, 1.0f));
+
+	secondModel = glm::translate(secondModel, glm::vec3(1.0f, 0.0f, -3.0f));
+	secondModel = glm::rotate(secondModel, glm::radians(-*angle * 10), glm::vec3(0.0f, 0.0f, 1.0f));
+
+	//The two meshes loaded by init, nothing is removed so they keep their positions
+	vulkanRenderer.updateModel(vulkanRenderer.getMeshHandle(0), firstModel);
+	vulkanRenderer.updateModel(vulkanRenderer.getMeshHandle(1), secondModel);
+}
+
+//Write RGBA8 pixels as a binary PPM (alpha dropped)
+void saveFrame(const std::string& fileName, const std::vector<uint8_t>& pixels, VkExtent2D extent)
+{
+	std::ofstream file(fileName, std::ios::binary);
+	file << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+	for(size_t i = 0; i < pixels.size(); i += 4)
+	{
+		file.write(reinterpret_cast<const char*>(&pixels[i]), 3);
+	}
+}
+
+//Print min/avg/max GPU time of every profiled scope
+void reportGpuTimings()
+{
+	for(const auto& scope : vulkanRenderer.getGpuTimings())
+	{
+		std::cout << "  GPU " << scope.name << ": " << scope.avgMs << " ms (min " << scope.minMs
+			<< ", max " << scope.maxMs << ", " << scope.count << " samples)" << std::endl;
+	}
+}
+
+//Render a fixed number of frames without window, vsync or compositor and report throughput
+int runHeadless(uint32_t frameCount)
+{
+	if (vulkanRenderer.initHeadless(800, 600) == EXIT_FAILURE)
+	{
+		return EXIT_FAILURE;
+	}
+
+	float angle = 0.0f;
+	const float deltaTime = 1.0f / 60.0f;		//Fixed step so the output is reproducible
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for(uint32_t i = 0; i < frameCount; i++)
+	{
+		updateScene(deltaTime, &angle);
+		vulkanRenderer.draw();
+	}
+	//Readback waits for the last frame, so the timing includes all GPU work
+	std::vector<uint8_t> pixels = vulkanRenderer.readFrame();
+	auto end = std::chrono::high_resolution_clock::now();
+
+	double seconds = std::chrono::duration<double>(end - start).count();
+	std::cout << "Rendered " << frameCount << " frames in " << seconds << " s ("
+		<< frameCount / seconds << " FPS, " << seconds * 1000.0 / frameCount << " ms/frame)" << std::endl;
+
+	reportGpuTimings();
+	reportMemoryStats();
+
+	saveFrame("headless_frame.ppm", pixels, vulkanRenderer.getFrameExtent());
+	dumpTrace("trace.json");
+
+	vulkanRenderer.cleanup();
+
+	return EXIT_SUCCESS;
+}
+
+//Measure command recording time from 1 to N recording threads
+int runRecordBenchmark(uint32_t objectCount)
+{
+	if (vulkanRenderer.initHeadless(800, 600) == EXIT_FAILURE)
+	{
+		return EXIT_FAILURE;
+	}
+
+	uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	vulkanRenderer.benchmarkRecording(maxThreads, objectCount, 100);
+
+	vulkanRenderer.cleanup();
+
+	return EXIT_SUCCESS;
+}
+
+//Compare staged uploads with direct writes to host visible VRAM
+int runUploadBenchmark(uint32_t iterations)
+{
+	if (vulkanRenderer.initHeadless(800, 600) == EXIT_FAILURE)
+	{
+		return EXIT_FAILURE;
+	}
+
+	vulkanRenderer.benchmarkUploads(iterations);
+
+	vulkanRenderer.cleanup();
+
+	return EXIT_SUCCESS;
+}
+
+//Print the pacing stats of the last frames once per second
+void reportFrameTiming(float now, float* lastReport)
+{
+	if(now - *lastReport < 1.0f) return;
+	*lastReport = now;
+
+	FrameTimingStats stats = vulkanRenderer.getFrameTimingStats();
+	std::cout << "Frame " << stats.avgFrameInterval << " ms (max " << stats.maxFrameInterval << ", target "
+		<< stats.targetInterval << "), cpu " << stats.avgCpuTime << " ms, submit->present "
+		<< stats.avgSubmitToPresent << " ms (max " << stats.maxSubmitToPresent << ")" << std::endl;
+	reportGpuTimings();
+}
+
+int main(int argc, char** argv)
+{
+	//--present low-latency|power-saving|fifo, --target-fps N (power-saving cap)
+	PresentPolicy presentPolicy = PresentPolicy::LowLatency;
+	double targetFps = 30.0;
+	for(int i = 1; i + 1 < argc; i++)
+	{
+		std::string option = argv[i];
+		std::string value = argv[i + 1];
+		if(option == "--present")
+		{
+			presentPolicy = value == "power-saving" ? PresentPolicy::PowerSaving
+				: value == "fifo" ? PresentPolicy::StrictFifo : PresentPolicy::LowLatency;
+		}
+		else if(option == "--target-fps")
+		{
+			targetFps = std::stod(value);
+		}
+	}
+	vulkanRenderer.setPresentPolicy(presentPolicy, targetFps);
+
+	//--frames-in-flight N: can follow any mode, picked before the renderer is initialized
+	for(int i = 1; i + 1 < argc; i++)
+	{
+		if(std::string(argv[i]) == "--frames-in-flight")
+		{
+			vulkanRenderer.setFramesInFlight(static_cast<uint32_t>(std::stoul(argv[i + 1])));
+		}
+	}
+
+	//--occlusion-culling: keeps the depth attachment for the pyramid, so it has to be picked before init too
+	for(int i = 1; i < argc; i++)
+	{
+		if(std::string(argv[i]) == "--occlusion-culling")
+		{
+			vulkanRenderer.setOcclusionCulling(true);
+		}
+	}
+
+	//--headless [frames]: no display needed (render nodes, software drivers such as lavapipe)
+	if(argc > 1 && std::string(argv[1]) == "--headless")
+	{
+		uint32_t frameCount = argc > 2 && argv[2][0] != '-' ? static_cast<uint32_t>(std::stoul(argv[2])) : 1000;
+		return runHeadless(frameCount);
+	}
+
+	//--bench-record [objects]: recording time scaling with thread count
+	if(argc > 1 && std::string(argv[1]) == "--bench-record")
+	{
+		uint32_t objectCount = argc > 2 && argv[2][0] != '-' ? static_cast<uint32_t>(std::stoul(argv[2])) : 10000;
+		return runRecordBenchmark(objectCount);
+	}
+
+	//--bench-upload [iterations]: staged vs direct upload latency and throughput
+	if(argc > 1 && std::string(argv[1]) == "--bench-upload")
+	{
+		uint32_t iterations = argc > 2 && argv[2][0] != '-' ? static_cast<uint32_t>(std::stoul(argv[2])) : 100;
+		return runUploadBenchmark(iterations);
+	}
+
 	//Create Window
 	initWindow("Test Window", 800, 600);
 
@@ -37,42 +301,36 @@ int main()
 	{
 		return EXIT_FAILURE;
 	}
+	glfwSetKeyCallback(window, keyCallback);
 
 	float angle = 0.0f;
 	float deltaTime = 0.0f;
 	float lastTime = 0.0f;
+	float lastReport = 0.0f;
 
 	//Loop until closed
 	while (!glfwWindowShouldClose(window))
 	{
-		glfwPollEvents();
+		//Pace before reading input, so the frame uses the freshest events
+		vulkanRenderer.waitForNextFrame();
+		{
+			TRACE_SCOPE("glfwPollEvents");
+			glfwPollEvents();
+		}
 
 		float now = glfwGetTime();
 		deltaTime = now - lastTime;
 		lastTime = now;
 
-		angle += 10.0f * deltaTime;
-		if(angle > 360.0f)
-		{
-			angle -= 360.0f;
-		}
-
-		
-		glm::mat4 firstModel(1.0f);
-		glm::mat4 secondModel(1.0f);
-		
-		firstModel = glm::translate(firstModel, glm::vec3(-1.0f, 0.0f, -2.5f));
-		firstModel = glm::rotate(firstModel, glm::radians(angle), glm::vec3(0.0f, 0.0f, 1.0f));
+		updateScene(deltaTime, &angle);
 
-		secondModel = glm::translate(secondModel, glm::vec3(1.0f, 0.0f, -3.0f));
-		secondModel = glm::rotate(secondModel, glm::radians(-angle * 10), glm::vec3(0.0f, 0.0f, 1.0f));
-
-		vulkanRenderer.updateModel(0,firstModel);
-		vulkanRenderer.updateModel(1,secondModel);
-		
 		vulkanRenderer.draw();
+
+		reportFrameTiming(now, &lastReport);
 	}
 
+	dumpTrace("trace.json");
+
 	vulkanRenderer.cleanup();
 
 	//Destroy GLFW window and stop GLFW
@@ -80,4 +338,4 @@ int main()
 	glfwTerminate();
 
 	return EXIT_SUCCESS;
-}
\ No newline at end of file
+}